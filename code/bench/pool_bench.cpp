@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <list>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include "../threadpool/threadpool.h"
+
+//线程池测试用的任务，接口与http_conn中线程池用到的部分相同
+struct task {
+    int m_state;
+    task *m_task_next;
+    long long m_enqueue_us;
+    int m_sched_class;
+    int spin;               //process中空转的次数，模拟处理一个静态请求
+    int block_us;           //数据库类别的任务在process中阻塞的微秒数，模拟mysql_query
+    long long done_us;      //执行完的时刻
+    std::atomic<int> hits;  //被执行的次数，必须恰好为1
+
+    int classify() const { return m_sched_class; }
+
+    bool read_once() { return true; }
+
+    bool write() { return true; }
+
+    bool pipelined() const { return false; }
+
+    void post_completion(bool) {}
+
+    bool process();
+};
+
+static std::atomic<long> g_done(0);
+
+bool task::process() {
+    for (volatile int i = 0; i < spin; ++i);
+    if (SCHED_DB == m_sched_class && block_us)
+        usleep(block_us);
+    done_us = pool_now_us();
+    hits.fetch_add(1, std::memory_order_relaxed);
+    g_done.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+//原来的线程池，从基线版本复制：一个互斥锁保护的std::list加一个信号量
+//只保留proactor路径，去掉数据库连接，并加上退出标志以便测试结束时回收线程
+class list_pool {
+public:
+    list_pool(int thread_number, int max_requests)
+            : m_thread_number(thread_number), m_max_requests(max_requests), m_stop(false) {
+        m_threads = new pthread_t[m_thread_number];
+        for (int i = 0; i < thread_number; ++i) {
+            if (pthread_create(m_threads + i, NULL, worker, this) != 0)
+                throw std::exception();
+        }
+    }
+
+    ~list_pool() {
+        m_stop = true;
+        for (int i = 0; i < m_thread_number; ++i)
+            m_queuestat.post();
+        for (int i = 0; i < m_thread_number; ++i)
+            pthread_join(m_threads[i], NULL);
+        delete[] m_threads;
+    }
+
+    bool append_p(task *request) {
+        m_queuelocker.lock();
+        if ((int) m_workqueue.size() >= m_max_requests) {
+            m_queuelocker.unlock();
+            return false;
+        }
+        m_workqueue.push_back(request);
+        m_queuelocker.unlock();
+        m_queuestat.post();
+        return true;
+    }
+
+private:
+    static void *worker(void *arg) {
+        list_pool *pool = (list_pool *) arg;
+        pool->run();
+        return pool;
+    }
+
+    void run() {
+        while (!m_stop) {
+            m_queuestat.wait();
+            m_queuelocker.lock();
+            if (m_workqueue.empty()) {
+                m_queuelocker.unlock();
+                continue;
+            }
+            task *request = m_workqueue.front();
+            m_workqueue.pop_front();
+            m_queuelocker.unlock();
+            if (!request)
+                continue;
+            request->process();
+        }
+    }
+
+    int m_thread_number;
+    int m_max_requests;
+    pthread_t *m_threads;
+    std::list<task *> m_workqueue;
+    locker m_queuelocker;
+    sem m_queuestat;
+    volatile bool m_stop;
+};
+
+/**
+ * @brief 等待所有任务执行完，检查每个任务恰好执行一次
+ * @param tasks
+ * @return 执行次数不为1的任务数
+ */
+static int wait_done(std::vector<task> &tasks) {
+    while (g_done.load(std::memory_order_acquire) < (long) tasks.size())
+        std::this_thread::yield();
+    int bad = 0;
+    for (size_t i = 0; i < tasks.size(); ++i)
+        bad += tasks[i].hits.load() != 1;
+    return bad;
+}
+
+static void reset(std::vector<task> &tasks, int spin) {
+    g_done = 0;
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        tasks[i].hits = 0;
+        tasks[i].spin = spin;
+        tasks[i].block_us = 0;
+        tasks[i].m_state = 0;
+        tasks[i].m_sched_class = SCHED_STATIC;
+    }
+}
+
+/**
+ * @brief producers个线程像事件循环一样把任务提交给线程池，batch为每次提交的任务数，
+ * 原来的线程池只能一个一个提交，队列满时重试
+ * @param mode -1为原来的线程池，否则为QUEUE_MODE
+ * @return 每秒执行的任务数
+ */
+static double throughput(int mode, int threads, int producers, int batch, std::vector<task> &tasks, int *bad) {
+    list_pool *old_pool = mode < 0 ? new list_pool(threads, 10000) : NULL;
+    threadpool<task> *pool = mode < 0 ? NULL : new threadpool<task>(0, threads, 10000, mode);
+
+    long long start = pool_now_us();
+    std::vector<std::thread> workers;
+    for (int p = 0; p < producers; ++p) {
+        workers.push_back(std::thread([&, p]() {
+            std::vector<task *> pending;
+            for (size_t i = p; i < tasks.size(); i += producers) {
+                pending.push_back(&tasks[i]);
+                if ((int) pending.size() < batch && i + producers < tasks.size())
+                    continue;
+                size_t off = 0;
+                while (off < pending.size()) {
+                    int k;
+                    if (old_pool)
+                        k = old_pool->append_p(pending[off]) ? 1 : 0;
+                    else
+                        k = pool->append_batch(&pending[off], (int) (pending.size() - off));
+                    off += k;
+                    if (!k)
+                        std::this_thread::yield();
+                }
+                pending.clear();
+            }
+        }));
+    }
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+    *bad = wait_done(tasks);
+    long long us = pool_now_us() - start;
+
+    delete old_pool;
+    delete pool;
+    return (double) tasks.size() * 1000000 / us;
+}
+
+/**
+ * @brief 每三个任务中一个是阻塞50毫秒的数据库请求，其余是静态请求，每300微秒提交一个，
+ * 统计静态请求从提交到执行完的时间，比较给各类别保留线程和不保留的情况
+ * @param reserved 各类别保留的线程数
+ * @param avg_us 静态请求的平均延迟
+ * @param max_us 静态请求的最大延迟
+ * @return 执行次数不为1的任务数
+ */
+static int isolation(int threads, const int *reserved, long long *avg_us, long long *max_us) {
+    std::vector<task> tasks(600);
+    std::vector<long long> submit_us(tasks.size());
+    reset(tasks, 0);
+    threadpool<task> pool(0, threads, 10000, QUEUE_WORK_STEALING, 0, 20, 30, reserved);
+
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        tasks[i].m_sched_class = i % 3 == 0 ? SCHED_DB : SCHED_STATIC;
+        tasks[i].block_us = 50000;
+        task *request = &tasks[i];
+        submit_us[i] = pool_now_us();
+        while (!pool.append_batch(&request, 1))
+            std::this_thread::yield();
+        usleep(300);
+    }
+    int bad = wait_done(tasks);
+
+    long long sum = 0;
+    int count = 0;
+    *max_us = 0;
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        if (SCHED_DB == tasks[i].m_sched_class)
+            continue;
+        long long latency = tasks[i].done_us - submit_us[i];
+        sum += latency;
+        ++count;
+        if (latency > *max_us)
+            *max_us = latency;
+    }
+    *avg_us = sum / count;
+    return bad;
+}
+
+int main(int argc, char *argv[]) {
+    int n = argc > 1 ? atoi(argv[1]) : 200000;
+    int threads = argc > 2 ? atoi(argv[2]) : 8;
+    std::vector<task> tasks(n);
+    int failed = 0;
+
+    printf("%u cpus, %d workers, %d tasks\n", std::thread::hardware_concurrency(), threads, n);
+    printf("%14s %9s %6s %12s\n", "pool", "producers", "batch", "tasks/s");
+    const int producer_counts[] = {1, 4};
+    for (int p = 0; p < 2; ++p) {
+        const struct {
+            const char *name;
+            int mode;
+            int batch;
+        } runs[] = {
+                {"mutex+list", -1, 1},
+                {"work-stealing", QUEUE_WORK_STEALING, 1},
+                {"work-stealing", QUEUE_WORK_STEALING, MAX_BATCH},
+                {"ring", QUEUE_RING, 1},
+                {"ring", QUEUE_RING, MAX_BATCH},
+        };
+        for (size_t r = 0; r < sizeof(runs) / sizeof(runs[0]); ++r) {
+            int bad = 0;
+            reset(tasks, 200);
+            double rate = throughput(runs[r].mode, threads, producer_counts[p], runs[r].batch, tasks, &bad);
+            printf("%14s %9d %6d %12.0f%s\n", runs[r].name, producer_counts[p], runs[r].batch, rate,
+                   bad ? "  LOST OR DUPLICATED TASKS" : "");
+            failed += bad;
+        }
+    }
+
+    printf("\n%d workers, 1/3 of tasks block 50 ms in the db class\n", threads);
+    printf("%18s %14s %14s\n", "reserved s/db/a", "static avg us", "static max us");
+    const int reservations[][SCHED_CLASS_NUM] = {{0, 0, 0}, {2, 1, 0}};
+    for (int r = 0; r < 2; ++r) {
+        long long avg_us, max_us;
+        failed += isolation(threads, reservations[r], &avg_us, &max_us);
+        printf("%12d/%d/%d %14lld %14lld\n", reservations[r][SCHED_STATIC], reservations[r][SCHED_DB],
+               reservations[r][SCHED_ADMIN], avg_us, max_us);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <string>
+#include <vector>
+#include "../http/http_scanner.h"
+
+static const char *IMPLS[] = {"scalar", "sse4.2", "avx2"};
+static const int IMPL_NUM = sizeof(IMPLS) / sizeof(IMPLS[0]);
+
+//请求解析中实际查找的分隔符对
+static const char DELIMS[][2] = {{'\r', '\n'}, {' ', '\t'}, {':', ':'}};
+static const int DELIM_NUM = sizeof(DELIMS) / sizeof(DELIMS[0]);
+
+static unsigned long long g_rand = 88172645463325252ULL;
+
+static unsigned long long next_rand() {
+    g_rand ^= g_rand << 13;
+    g_rand ^= g_rand >> 7;
+    g_rand ^= g_rand << 17;
+    return g_rand;
+}
+
+static long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief 一个浏览器风格的请求，头部长度和取值随机变化
+ * @return
+ */
+static std::string make_request() {
+    static const char *paths[] = {"/", "/judge.html", "/login.gif", "/2CGISQL.cgi", "/0"};
+    std::string req = std::string("GET ") + paths[next_rand() % 5] + " HTTP/1.1\r\n";
+    req += "Host: 127.0.0.1:9006\r\n";
+    req += "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0\r\n";
+    req += "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n";
+    req += "Accept-Encoding: gzip, deflate, br\r\n";
+    req += "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n";
+    req += "Cookie: session=";
+    int cookie = (int) (next_rand() % 200);
+    for (int i = 0; i < cookie; ++i)
+        req += (char) ('a' + next_rand() % 26);
+    req += "\r\nConnection: keep-alive\r\n\r\n";
+    return req;
+}
+
+/**
+ * @brief 把数据放在一页的末尾，后面紧跟一个不可访问的页，向量实现越界读取时会直接崩溃
+ */
+class guarded_buf {
+public:
+    guarded_buf(size_t size) {
+        long page = sysconf(_SC_PAGESIZE);
+        m_len = (size + page - 1) / page * page + page;
+        m_mem = (char *) mmap(NULL, m_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m_mem == MAP_FAILED) {
+            perror("mmap");
+            exit(1);
+        }
+        mprotect(m_mem + m_len - page, page, PROT_NONE);
+        m_end = m_mem + m_len - page;
+    }
+
+    ~guarded_buf() { munmap(m_mem, m_len); }
+
+    //把data复制到紧贴保护页的位置，返回起始地址
+    char *place(const char *data, size_t size) {
+        char *begin = m_end - size;
+        memcpy(begin, data, size);
+        return begin;
+    }
+
+private:
+    char *m_mem;
+    char *m_end;
+    size_t m_len;
+};
+
+/**
+ * @brief 用每个实现在同一段数据的每个起点上查找，和逐字节实现比较返回的偏移
+ * @param data
+ * @param size
+ * @param impls 可用的实现
+ * @return 不一致的次数
+ */
+static long check(const char *data, size_t size, const std::vector<const char *> &impls) {
+    static guarded_buf buf(1 << 20);
+    const char *begin = buf.place(data, size);
+    const char *end = begin + size;
+    long mismatches = 0;
+    for (int d = 0; d < DELIM_NUM; ++d) {
+        for (const char *p = begin; p <= end; ++p) {
+            http_scanner::use("scalar");
+            const char *expect = http_scanner::find(p, end, DELIMS[d][0], DELIMS[d][1]);
+            for (size_t i = 1; i < impls.size(); ++i) {
+                http_scanner::use(impls[i]);
+                const char *got = http_scanner::find(p, end, DELIMS[d][0], DELIMS[d][1]);
+                if (got != expect) {
+                    if (mismatches < 10)
+                        fprintf(stderr, "%s: start %ld delim %d got %ld expect %ld\n", impls[i],
+                                (long) (p - begin), d, (long) (got - begin), (long) (expect - begin));
+                    ++mismatches;
+                }
+            }
+        }
+    }
+    return mismatches;
+}
+
+/**
+ * @brief 模拟parse_line和parse_headers的查找：按CRLF切行，再在每行中找冒号
+ * @param data
+ * @param size
+ * @return 找到的分隔符数，防止循环被优化掉
+ */
+static long scan(const char *data, size_t size) {
+    const char *p = data;
+    const char *end = data + size;
+    long found = 0;
+    while (p < end) {
+        const char *eol = http_scanner::find(p, end, '\r', '\n');
+        const char *colon = http_scanner::find(p, eol, ':', ':');
+        found += (colon != eol);
+        p = eol + 1;
+    }
+    return found;
+}
+
+int main(int argc, char *argv[]) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 200;
+
+    std::vector<const char *> impls;
+    for (int i = 0; i < IMPL_NUM; ++i) {
+        if (http_scanner::use(IMPLS[i]))
+            impls.push_back(IMPLS[i]);
+        else
+            printf("%s: not supported by this CPU, skipped\n", IMPLS[i]);
+    }
+
+    //正确性：真实请求、随机字节，以及长度0到80的短串，覆盖向量宽度前后的边界
+    long mismatches = 0;
+    std::string req = make_request() + make_request();
+    mismatches += check(req.data(), req.size(), impls);
+    std::string noise(4096, 'x');
+    for (size_t i = 0; i < noise.size(); ++i) {
+        unsigned r = (unsigned) (next_rand() % 64);
+        noise[i] = r < 4 ? "\r\n: "[r] : (char) (next_rand() & 0xff);
+    }
+    mismatches += check(noise.data(), noise.size(), impls);
+    for (int len = 0; len <= 80; ++len) {
+        for (int pos = 0; pos <= len; ++pos) {
+            std::string s(len, 'a');
+            if (pos < len)
+                s[pos] = '\n';
+            mismatches += check(s.data(), s.size(), impls);
+        }
+    }
+    printf("offsets %s across %d implementations (%ld mismatches)\n",
+           mismatches ? "DIFFER" : "identical", (int) impls.size(), mismatches);
+
+    //速度：1000个流水线请求连在一起，每个实现扫描相同的数据
+    std::string batch;
+    for (int i = 0; i < 1000; ++i)
+        batch += make_request();
+    printf("%8s %12s %12s\n", "impl", "GB/s", "ns/request");
+    long expect = -1;
+    for (size_t i = 0; i < impls.size(); ++i) {
+        http_scanner::use(impls[i]);
+        long found = scan(batch.data(), batch.size());
+        long long start = now_ns();
+        for (int r = 0; r < rounds; ++r)
+            found = scan(batch.data(), batch.size());
+        long long ns = now_ns() - start;
+        if (expect >= 0 && found != expect)
+            ++mismatches;
+        expect = found;
+        printf("%8s %12.2f %12.1f\n", impls[i], (double) batch.size() * rounds / ns, (double) ns / rounds / 1000);
+    }
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+#include "../timer/lst_timer.h"
+
+//原来的升序双向链表定时器，从基线版本复制，只把秒级的time(NULL)换成传入的毫秒时刻，用来和时间轮对比
+class sort_timer_lst {
+public:
+    sort_timer_lst() : head(NULL), tail(NULL) {}
+
+    ~sort_timer_lst() {
+        util_timer *tmp = head;
+        while (tmp) {
+            head = tmp->next;
+            delete tmp;
+            tmp = head;
+        }
+    }
+
+    void add_timer(util_timer *timer) {
+        if (!timer) {
+            return;
+        }
+        if (!head) {
+            head = tail = timer;
+            return;
+        }
+        if (timer->expire < head->expire) {
+            timer->next = head;
+            head->prev = timer;
+            head = timer;
+            return;
+        }
+        add_timer(timer, head);
+    }
+
+    void adjust_timer(util_timer *timer) {
+        if (!timer) {
+            return;
+        }
+        util_timer *tmp = timer->next;
+        if (!tmp || (timer->expire < tmp->expire)) {
+            return;
+        }
+        if (timer == head) {
+            head = head->next;
+            head->prev = NULL;
+            timer->next = NULL;
+            add_timer(timer, head);
+        } else {
+            timer->prev->next = timer->next;
+            timer->next->prev = timer->prev;
+            add_timer(timer, timer->next);
+        }
+    }
+
+    void del_timer(util_timer *timer) {
+        if (!timer) {
+            return;
+        }
+        if ((timer == head) && (timer == tail)) {
+            delete timer;
+            head = NULL;
+            tail = NULL;
+            return;
+        }
+        if (timer == head) {
+            head = head->next;
+            head->prev = NULL;
+            delete timer;
+            return;
+        }
+        if (timer == tail) {
+            tail = tail->prev;
+            tail->next = NULL;
+            delete timer;
+            return;
+        }
+        timer->prev->next = timer->next;
+        timer->next->prev = timer->prev;
+        delete timer;
+    }
+
+    void tick(long long cur) {
+        util_timer *tmp = head;
+        while (tmp) {
+            if (cur < tmp->expire) {
+                break;
+            }
+            tmp->cb_func(tmp->user_data);
+            head = tmp->next;
+            if (head) {
+                head->prev = NULL;
+            }
+            delete tmp;
+            tmp = head;
+        }
+    }
+
+private:
+    void add_timer(util_timer *timer, util_timer *lst_head) {
+        util_timer *prev = lst_head;
+        util_timer *tmp = prev->next;
+        while (tmp) {
+            if (timer->expire < tmp->expire) {
+                prev->next = timer;
+                timer->next = tmp;
+                tmp->prev = timer;
+                timer->prev = prev;
+                break;
+            }
+            prev = tmp;
+            tmp = tmp->next;
+        }
+        if (!tmp) {
+            prev->next = timer;
+            timer->prev = prev;
+            timer->next = NULL;
+            tail = timer;
+        }
+    }
+
+    util_timer *head;
+    util_timer *tail;
+};
+
+static const long long IDLE_MS = 15000;     //和默认的空闲超时一样
+
+static unsigned long long g_rand = 88172645463325252ULL;
+
+/**
+ * @brief xorshift随机数，两种定时器使用相同的序列
+ * @return
+ */
+static unsigned long long next_rand() {
+    g_rand ^= g_rand << 13;
+    g_rand ^= g_rand >> 7;
+    g_rand ^= g_rand << 17;
+    return g_rand;
+}
+
+static bool noop_cb(client_data *) {
+    return false;
+}
+
+static long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//一次测试的结果，单位都是每次操作的纳秒数
+struct result {
+    double add;
+    double adjust;
+    double del;
+};
+
+/**
+ * @brief 模拟服务器的用法：conns个连接各有一个空闲定时器，每次读写把一个随机连接的定时器推迟到当前时刻加空闲超时，
+ * 每处理一批请求调用一次tick，最后关闭所有连接
+ * @param list true测试链表，false测试时间轮
+ * @param conns
+ * @param ops
+ * @return
+ */
+static result run(bool list, int conns, int ops) {
+    sort_timer_lst lst;
+    timer_wheel wheel;
+    std::vector<util_timer *> timers(conns);
+    result r;
+
+    long long start = now_ns();
+    for (int i = 0; i < conns; ++i) {
+        util_timer *timer = list ? new util_timer : wheel.get_timer();
+        timer->cb_func = noop_cb;
+        timer->user_data = NULL;
+        //连接陆续到来，超时时刻分散在一个空闲周期内
+        timer->expire = now_ms() + IDLE_MS + (long long) (next_rand() % IDLE_MS);
+        timers[i] = timer;
+        if (list)
+            lst.add_timer(timer);
+        else
+            wheel.add_timer(timer);
+    }
+    r.add = (double) (now_ns() - start) / conns;
+
+    start = now_ns();
+    for (int i = 0; i < ops; ++i) {
+        util_timer *timer = timers[next_rand() % conns];
+        timer->expire = now_ms() + 2 * IDLE_MS;
+        if (list)
+            lst.adjust_timer(timer);
+        else
+            wheel.adjust_timer(timer);
+        if ((i & 63) == 63) {
+            if (list)
+                lst.tick(now_ms());
+            else
+                wheel.tick();
+        }
+    }
+    r.adjust = (double) (now_ns() - start) / ops;
+
+    start = now_ns();
+    for (int i = 0; i < conns; ++i) {
+        if (list)
+            lst.del_timer(timers[i]);
+        else
+            wheel.del_timer(timers[i]);
+    }
+    r.del = (double) (now_ns() - start) / conns;
+    return r;
+}
+
+int main(int argc, char *argv[]) {
+    int ops = argc > 1 ? atoi(argv[1]) : 100000;
+    const int sizes[] = {100, 1000, 10000};
+
+    printf("%8s %8s %12s %12s %12s\n", "conns", "timer", "add ns/op", "adjust ns/op", "del ns/op");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        unsigned long long seed = g_rand;
+        result l = run(true, sizes[i], ops);
+        g_rand = seed;
+        result w = run(false, sizes[i], ops);
+        printf("%8d %8s %12.1f %12.1f %12.1f\n", sizes[i], "list", l.add, l.adjust, l.del);
+        printf("%8d %8s %12.1f %12.1f %12.1f\n", sizes[i], "wheel", w.add, w.adjust, w.del);
+    }
+    return 0;
+}
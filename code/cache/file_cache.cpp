@@ -0,0 +1,631 @@
+#include "file_cache.h"
+
+/**
+ * @brief 单例模式，第一次使用时创建
+ * @return
+ */
+file_cache *file_cache::get_instance() {
+    static file_cache cache;
+    return &cache;
+}
+
+/**
+ * @brief 构造函数，init之前不缓存，每次借用都重新打开文件
+ */
+file_cache::file_cache() {
+    m_bytes = 0;
+    m_budget = 0;
+    m_sendfile_threshold = -1;
+    m_inotifyfd = -1;
+    m_close_log = 1;
+}
+
+/**
+ * @brief 析构函数，释放没有被借用的缓存项
+ */
+file_cache::~file_cache() {
+    m_lock.lock();
+    invalidate_all();
+    m_lock.unlock();
+}
+
+/**
+ * @brief 初始化缓存，启动inotify线程
+ * @param budget 缓存的字节预算，0表示不缓存
+ * @param sendfile_threshold 不小于该大小的文件保存描述符用sendfile发送，-1表示全部映射
+ * @param close_log 是否关闭日志
+ */
+void file_cache::init(long long budget, int sendfile_threshold, int close_log) {
+    m_budget = budget;
+    m_sendfile_threshold = sendfile_threshold;
+    m_close_log = close_log;
+
+    if (m_budget <= 0 || m_inotifyfd != -1)
+        return;
+    m_inotifyfd = inotify_init1(IN_CLOEXEC);
+    if (m_inotifyfd < 0) {
+        LOG_WARN("inotify_init1 failed(%d), file cache will not notice changed files", errno);
+        return;
+    }
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, inotify_thread, this) != 0) {
+        close(m_inotifyfd);
+        m_inotifyfd = -1;
+        throw std::exception();
+    }
+    pthread_detach(tid);
+}
+
+/**
+ * @brief 借用一个文件，命中时只需要查表
+ * 只缓存其它用户可读的普通文件，不存在、无权限、目录等情况返回NULL，由调用者自己区分
+ * @param path 解析后的文件路径
+ * @return 用完后必须调用release归还
+ */
+file_entry *file_cache::acquire(const char *path) {
+    std::string key = normalize(path);
+    file_entry *entry = find(key);
+    if (entry)
+        return entry;
+
+    //未命中时不持锁打开文件，其它线程照常命中
+    entry = open_entry(key);
+    if (!entry)
+        return NULL;
+
+    m_lock.lock();
+    std::unordered_map<std::string, file_entry *>::iterator it = m_entries.find(key);
+    if (it != m_entries.end()) {
+        //其它线程同时打开并缓存了同一个文件，用已经缓存的
+        file_entry *cached = it->second;
+        ++cached->ref;
+        m_lru.splice(m_lru.begin(), m_lru, cached->lru);
+        m_lock.unlock();
+        destroy(entry);
+        return cached;
+    }
+    entry->ref = 1;
+    //超过整个预算的文件不缓存，最后一个借用者归还时释放
+    if (entry->st.st_size <= m_budget) {
+        entry->cached = true;
+        m_entries[entry->path] = entry;
+        m_lru.push_front(entry);
+        entry->lru = m_lru.begin();
+        m_bytes += entry->charge;
+        evict();
+        watch(entry->path);
+    }
+    m_lock.unlock();
+    return entry;
+}
+
+/**
+ * @brief 只在缓存中查找，未命中时不打开文件，用于条件请求先比较校验器
+ * @param path 解析后的文件路径
+ * @return 命中时借出缓存项，用完后必须调用release归还；未命中返回NULL
+ */
+file_entry *file_cache::lookup(const char *path) {
+    return find(normalize(path));
+}
+
+/**
+ * @brief 按规范化后的路径在缓存中查找，命中时借出缓存项
+ * @param key
+ * @return
+ */
+file_entry *file_cache::find(const std::string &key) {
+    file_entry *entry = NULL;
+    m_lock.lock();
+    std::unordered_map<std::string, file_entry *>::iterator it = m_entries.find(key);
+    if (it != m_entries.end()) {
+        entry = it->second;
+        ++entry->ref;
+        m_lru.splice(m_lru.begin(), m_lru, entry->lru);
+    }
+    m_lock.unlock();
+    return entry;
+}
+
+/**
+ * @brief 把路径规范化为缓存的键，合并重复的/，去掉.，..回退一级，到根目录为止
+ * 同一个文件的不同写法（/a//b、/a/./b、/a/c/../b）只占一个缓存项，inotify事件拼出的路径也能找到它
+ * 按字面处理，不解析符号链接，不需要额外的系统调用；保留结尾的/，目录照旧打开失败
+ * @param path 绝对路径
+ * @return
+ */
+std::string file_cache::normalize(const char *path) {
+    std::string key;
+    key.reserve(strlen(path));
+    const char *p = path;
+    while (*p) {
+        while (*p == '/')
+            ++p;
+        const char *end = p;
+        while (*end && *end != '/')
+            ++end;
+        size_t len = end - p;
+        if (len == 2 && p[0] == '.' && p[1] == '.') {
+            size_t slash = key.rfind('/');
+            key.resize(slash == std::string::npos ? 0 : slash);
+        } else if (len > 0 && !(len == 1 && p[0] == '.')) {
+            key += '/';
+            key.append(p, len);
+        }
+        p = end;
+    }
+    if (key.empty() || (p > path && p[-1] == '/'))
+        key += '/';
+    return key;
+}
+
+/**
+ * @brief 由inode、大小和mtime生成ETag，文件被修改或替换后都会变化
+ * @param etag 输出，不含引号
+ * @param size
+ * @param st
+ * @return 长度
+ */
+int file_cache::format_etag(char *etag, int size, const struct stat &st) {
+    return snprintf(etag, size, "%lx-%llx-%lx", (unsigned long) st.st_ino, (unsigned long long) st.st_size,
+                    (unsigned long) st.st_mtime);
+}
+
+/**
+ * @brief 按RFC 7231的IMF-fixdate格式化时间，用于Last-Modified
+ * @param date
+ * @param size
+ * @param t
+ * @return 长度
+ */
+int file_cache::format_http_date(char *date, int size, time_t t) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    return strftime(date, size, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+/**
+ * @brief If-None-Match的列表中是否有文件或它某个压缩版本的ETag
+ * 按弱比较，忽略W/前缀，*匹配任何存在的文件；压缩版本的ETag只在客户端仍接受该编码时匹配
+ * @param list If-None-Match的值
+ * @param etag format_etag生成的ETag
+ * @param accept 客户端接受的编码，第i位对应CONTENT_ENCODING中的第i种
+ * @param encoding 输出，匹配的是压缩版本时为它的编码，否则为-1，304响应据此带上对应的ETag
+ * @return
+ */
+bool file_cache::etag_match(const char *list, const char *etag, int accept, int *encoding) {
+    static const char *encodings[ENCODING_NUM] = {"gzip", "deflate"};
+    size_t len = strlen(etag);
+    const char *p = list;
+    while (*(p += strspn(p, " \t,"))) {
+        if (*p == '*') {
+            *encoding = -1;
+            return true;
+        }
+        if (strncmp(p, "W/", 2) == 0)
+            p += 2;
+        if (*p != '"')
+            return false;
+        const char *end = strchr(p + 1, '"');
+        if (!end)
+            return false;
+        const char *tag = p + 1;
+        size_t n = end - tag;
+        if (n >= len && strncmp(tag, etag, len) == 0) {
+            if (n == len) {
+                *encoding = -1;
+                return true;
+            }
+            for (int i = 0; i < ENCODING_NUM; ++i) {
+                if ((accept & (1 << i)) && tag[len] == '-' && n == len + 1 + strlen(encodings[i]) &&
+                    strncmp(tag + len + 1, encodings[i], n - len - 1) == 0) {
+                    *encoding = i;
+                    return true;
+                }
+            }
+        }
+        p = end + 1;
+    }
+    return false;
+}
+
+/**
+ * @brief 归还acquire借出的文件，已经不在缓存中的文件由最后一个借用者释放
+ * @param entry
+ */
+void file_cache::release(file_entry *entry) {
+    m_lock.lock();
+    bool last = 0 == --entry->ref && !entry->cached;
+    m_lock.unlock();
+    if (last)
+        destroy(entry);
+}
+
+/**
+ * @brief 打开文件并建立缓存项，小文件映射后关闭描述符，大文件保留描述符
+ * @param path
+ * @return
+ */
+file_entry *file_cache::open_entry(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    file_entry *entry = new file_entry;
+    entry->path = path;
+    entry->addr = NULL;
+    entry->fd = -1;
+    entry->ref = 0;
+    entry->cached = false;
+    for (int i = 0; i < ENCODING_NUM; ++i)
+        entry->variant[i] = NULL;
+    if (fstat(fd, &entry->st) < 0 || !S_ISREG(entry->st.st_mode) || !(entry->st.st_mode & S_IROTH)) {
+        close(fd);
+        delete entry;
+        return NULL;
+    }
+
+    //文件变化时整个缓存项失效，响应头、校验器和文件内容一起更新
+    format_etag(entry->etag, sizeof(entry->etag), entry->st);
+    format_http_date(entry->last_modified, sizeof(entry->last_modified), entry->st.st_mtime);
+    entry->type = content_type(entry->path);
+    entry->compressible = is_compressible(entry->type);
+    for (int linger = 0; linger < 2; ++linger)
+        entry->header_len[linger] = build_header(entry->header[linger], sizeof(entry->header[linger]), entry,
+                                                 entry->st.st_size, NULL, linger);
+    entry->charge = entry->st.st_size;
+
+    //磁盘上有不比原文件旧的.gz文件时直接作为gzip版本
+    if (entry->compressible) {
+        entry->variant[ENCODING_GZIP] = load_gz(entry);
+        if (entry->variant[ENCODING_GZIP])
+            entry->charge += entry->variant[ENCODING_GZIP]->len;
+    }
+
+    if (m_sendfile_threshold >= 0 && entry->st.st_size >= m_sendfile_threshold && entry->st.st_size > 0) {
+        entry->fd = fd;
+        return entry;
+    }
+    if (entry->st.st_size > 0) {
+        void *addr = mmap(0, entry->st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            close(fd);
+            delete entry;
+            return NULL;
+        }
+        entry->addr = (char *) addr;
+    }
+    close(fd);
+    return entry;
+}
+
+/**
+ * @brief 根据扩展名得到响应的Content-Type
+ * @param path
+ * @return
+ */
+const char *file_cache::content_type(const std::string &path) {
+    static const char *types[][2] = {
+            {".html", "text/html"},
+            {".css",  "text/css"},
+            {".js",   "application/javascript"},
+            {".txt",  "text/plain"},
+            {".jpg",  "image/jpeg"},
+            {".jpeg", "image/jpeg"},
+            {".png",  "image/png"},
+            {".gif",  "image/gif"},
+            {".ico",  "image/x-icon"},
+            {".mp4",  "video/mp4"},
+    };
+    size_t dot = path.rfind('.');
+    if (dot != std::string::npos) {
+        for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i) {
+            if (strcasecmp(path.c_str() + dot, types[i][0]) == 0)
+                return types[i][1];
+        }
+    }
+    return "application/octet-stream";
+}
+
+/**
+ * @brief 文本类的内容压缩效果好，图片、视频本身已经压缩过
+ * @param type
+ * @return
+ */
+bool file_cache::is_compressible(const char *type) {
+    return strncmp(type, "text/", 5) == 0 || strcmp(type, "application/javascript") == 0;
+}
+
+/**
+ * @brief 序列化200响应中状态行和Date之后的头部
+ * @param header 输出缓冲区
+ * @param size 输出缓冲区大小
+ * @param entry 文件的缓存项
+ * @param length 响应体长度
+ * @param encoding Content-Encoding，原样发送时为NULL
+ * @param linger 是否保持连接
+ * @return 响应头长度
+ */
+int file_cache::build_header(char *header, int size, const file_entry *entry, long long length,
+                             const char *encoding, bool linger) {
+    int len = snprintf(header, size, "Content-Length:%lld\r\nContent-Type:%s\r\n",
+                       length, entry->type);
+    //压缩版本是不同的表示，强ETag要和原文件区分开
+    if (encoding)
+        len += snprintf(header + len, size - len, "Content-Encoding:%s\r\nETag:\"%s-%s\"\r\n",
+                        encoding, entry->etag, encoding);
+    else
+        len += snprintf(header + len, size - len, "Accept-Ranges:bytes\r\nETag:\"%s\"\r\n", entry->etag);
+    len += snprintf(header + len, size - len, "Last-Modified:%s\r\n", entry->last_modified);
+    //可压缩的内容按Accept-Encoding返回不同的版本，告诉中间缓存区分
+    if (entry->compressible)
+        len += snprintf(header + len, size - len, "Vary:Accept-Encoding\r\n");
+    len += snprintf(header + len, size - len, "Connection:%s\r\n\r\n", linger ? "keep-alive" : "close");
+    return len;
+}
+
+/**
+ * @brief 映射磁盘上预先压缩好的.gz文件，比原文件旧时不用
+ * @param entry
+ * @return
+ */
+file_variant *file_cache::load_gz(file_entry *entry) {
+    std::string gz = entry->path + ".gz";
+    int fd = open(gz.c_str(), O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 || st.st_mtime < entry->st.st_mtime) {
+        close(fd);
+        return NULL;
+    }
+    void *addr = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return NULL;
+
+    file_variant *variant = new file_variant;
+    variant->data = (char *) addr;
+    variant->len = st.st_size;
+    variant->mapped = true;
+    for (int linger = 0; linger < 2; ++linger)
+        variant->header_len[linger] = build_header(variant->header[linger], sizeof(variant->header[linger]), entry,
+                                                   variant->len, "gzip", linger);
+    return variant;
+}
+
+/**
+ * @brief 用zlib压缩文件内容，每个缓存项的每种编码只压缩一次，所以使用最高压缩级别
+ * @param entry
+ * @param encoding
+ * @return 压缩失败或者压缩后不比原文件小时data为NULL，同样缓存下来避免重复尝试
+ */
+file_variant *file_cache::compress(file_entry *entry, int encoding) {
+    file_variant *variant = new file_variant;
+    variant->data = NULL;
+    variant->len = 0;
+    variant->mapped = false;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    //gzip的窗口参数加16输出gzip格式，HTTP的deflate编码按约定是zlib格式
+    int window_bits = ENCODING_GZIP == encoding ? 15 + 16 : 15;
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return variant;
+
+    uLong bound = deflateBound(&zs, entry->st.st_size);
+    char *out = (char *) malloc(bound);
+    if (out) {
+        zs.next_in = (Bytef *) entry->addr;
+        zs.avail_in = entry->st.st_size;
+        zs.next_out = (Bytef *) out;
+        zs.avail_out = bound;
+        if (deflate(&zs, Z_FINISH) == Z_STREAM_END && (long long) zs.total_out < entry->st.st_size) {
+            variant->data = out;
+            variant->len = zs.total_out;
+        } else {
+            free(out);
+        }
+    }
+    deflateEnd(&zs);
+
+    if (variant->data) {
+        const char *name = ENCODING_GZIP == encoding ? "gzip" : "deflate";
+        for (int linger = 0; linger < 2; ++linger)
+            variant->header_len[linger] = build_header(variant->header[linger], sizeof(variant->header[linger]),
+                                                       entry, variant->len, name, linger);
+    }
+    return variant;
+}
+
+/**
+ * @brief 按客户端接受的编码取文件的压缩版本，第一次请求时压缩，之后直接复用
+ * 不在缓存中的文件（缓存关闭或超过预算）压缩结果无法复用，只使用磁盘上的.gz文件，不在每次请求时重新压缩
+ * 调用者必须借用着entry
+ * @param entry
+ * @param accept 客户端接受的编码，第i位对应CONTENT_ENCODING中的第i种
+ * @return 没有合适的压缩版本时返回NULL，按原样发送
+ */
+file_variant *file_cache::encoded(file_entry *entry, int accept) {
+    if (!entry->compressible)
+        return NULL;
+    for (int encoding = 0; encoding < ENCODING_NUM; ++encoding) {
+        if (!(accept & (1 << encoding)))
+            continue;
+
+        m_lock.lock();
+        file_variant *variant = entry->variant[encoding];
+        bool cached = entry->cached;
+        m_lock.unlock();
+        //sendfile发送的大文件没有映射，只能使用磁盘上的.gz文件
+        if (!variant && entry->addr && cached) {
+            //不持锁压缩，其它线程同时压缩了同一个文件时丢弃自己的结果
+            file_variant *compressed = compress(entry, encoding);
+            m_lock.lock();
+            variant = entry->variant[encoding];
+            if (!variant) {
+                variant = compressed;
+                compressed = NULL;
+                entry->variant[encoding] = variant;
+                if (entry->cached) {
+                    entry->charge += variant->len;
+                    m_bytes += variant->len;
+                    evict();
+                }
+            }
+            m_lock.unlock();
+            if (compressed)
+                destroy_variant(compressed);
+        }
+        if (variant && variant->data)
+            return variant;
+    }
+    return NULL;
+}
+
+/**
+ * @brief 释放一个压缩版本
+ * @param variant
+ */
+void file_cache::destroy_variant(file_variant *variant) {
+    if (variant->data) {
+        if (variant->mapped)
+            munmap(variant->data, variant->len);
+        else
+            free(variant->data);
+    }
+    delete variant;
+}
+
+/**
+ * @brief 释放缓存项的映射或描述符以及压缩版本
+ * @param entry
+ */
+void file_cache::destroy(file_entry *entry) {
+    if (entry->addr)
+        munmap(entry->addr, entry->st.st_size);
+    if (entry->fd >= 0)
+        close(entry->fd);
+    for (int i = 0; i < ENCODING_NUM; ++i) {
+        if (entry->variant[i])
+            destroy_variant(entry->variant[i]);
+    }
+    delete entry;
+}
+
+/**
+ * @brief 把缓存项移出缓存，没有借用者时立即释放，调用前需要持有锁
+ * @param entry
+ */
+void file_cache::remove(file_entry *entry) {
+    m_entries.erase(entry->path);
+    m_lru.erase(entry->lru);
+    m_bytes -= entry->charge;
+    entry->cached = false;
+    if (0 == entry->ref)
+        destroy(entry);
+}
+
+/**
+ * @brief 超出预算时从LRU表尾淘汰，正在被借用的文件等归还后再释放，调用前需要持有锁
+ */
+void file_cache::evict() {
+    while (m_bytes > m_budget && !m_lru.empty())
+        remove(m_lru.back());
+}
+
+/**
+ * @brief 监视文件所在的目录，每个目录只添加一次，调用前需要持有锁
+ * 监视目录而不是文件本身，文件被替换成新的inode时也能收到通知
+ * @param path
+ */
+void file_cache::watch(const std::string &path) {
+    if (m_inotifyfd < 0)
+        return;
+    std::string dir = path.substr(0, path.rfind('/'));
+    if (m_dir_wd.count(dir))
+        return;
+    int wd = inotify_add_watch(m_inotifyfd, dir.c_str(),
+                               IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                               IN_DELETE_SELF | IN_MOVE_SELF);
+    if (wd < 0) {
+        LOG_WARN("inotify_add_watch %s failed(%d)", dir.c_str(), errno);
+        return;
+    }
+    m_dir_wd[dir] = wd;
+    m_wd_dir[wd] = dir;
+}
+
+/**
+ * @brief 文件发生变化，让对应的缓存项失效，调用前需要持有锁
+ * @param path
+ */
+void file_cache::invalidate(const std::string &path) {
+    std::unordered_map<std::string, file_entry *>::iterator it = m_entries.find(path);
+    if (it != m_entries.end())
+        remove(it->second);
+}
+
+/**
+ * @brief 所有缓存项失效，inotify事件溢出或者目录本身被删除时使用，调用前需要持有锁
+ */
+void file_cache::invalidate_all() {
+    while (!m_lru.empty())
+        remove(m_lru.back());
+}
+
+/**
+ * @brief inotify线程入口
+ * @param arg
+ * @return
+ */
+void *file_cache::inotify_thread(void *arg) {
+    file_cache *cache = (file_cache *) arg;
+    cache->run();
+    return cache;
+}
+
+/**
+ * @brief 阻塞读取inotify事件，把变化的文件移出缓存
+ */
+void file_cache::run() {
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    while (true) {
+        int len = read(m_inotifyfd, buf, sizeof(buf));
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR("inotify read failed(%d), file cache stops tracking changes", errno);
+            break;
+        }
+
+        m_lock.lock();
+        for (char *p = buf; p < buf + len;) {
+            struct inotify_event *event = (struct inotify_event *) p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                invalidate_all();
+                continue;
+            }
+            std::map<int, std::string>::iterator it = m_wd_dir.find(event->wd);
+            if (it == m_wd_dir.end())
+                continue;
+            if (event->len > 0) {
+                std::string path = it->second + "/" + event->name;
+                invalidate(path);
+                //.gz文件变化时原文件的gzip版本也要更新
+                if (path.size() > 3 && path.compare(path.size() - 3, 3, ".gz") == 0)
+                    invalidate(path.substr(0, path.size() - 3));
+            }
+            //目录本身被删除或移走，监视随之失效，下次缓存该目录下的文件时重新添加
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                invalidate_all();
+                if (event->mask & IN_IGNORED) {
+                    m_dir_wd.erase(it->second);
+                    m_wd_dir.erase(it);
+                }
+            }
+        }
+        m_lock.unlock();
+    }
+}
@@ -0,0 +1,134 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <string>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <zlib.h>
+
+#include "../lock/locker.h"
+#include "../log/log.h"
+
+//支持的内容编码，按优先级排列
+enum CONTENT_ENCODING {
+    ENCODING_GZIP = 0,
+    ENCODING_DEFLATE,
+    ENCODING_NUM
+};
+
+//缓存文件的一个压缩版本，来自磁盘上的.gz文件或者第一次请求时用zlib压缩
+struct file_variant {
+    char *data;             //压缩后的内容，NULL表示压缩后不比原文件小，不使用该编码
+    int len;                //压缩后的长度
+    bool mapped;            //data是映射的.gz文件还是malloc的压缩结果
+    char header[2][352];    //预先序列化的200响应头，不含状态行和Date，带Content-Encoding和该编码的ETag
+    int header_len[2];      //两种响应头的长度
+};
+
+//缓存中的一个文件，小文件保存映射地址，不小于sendfile阈值的文件保存打开的描述符
+//缓存项对应打开时的那个文件版本，文件变化时整个缓存项连同压缩版本一起失效，相当于按路径和mtime缓存
+struct file_entry {
+    std::string path;       //规范化后的文件路径，也是缓存的键
+    struct stat st;         //打开文件时的状态
+    char *addr;             //文件映射地址，用sendfile发送或空文件时为NULL
+    int fd;                 //用sendfile发送的文件描述符，否则为-1
+    const char *type;       //按扩展名得到的Content-Type
+    bool compressible;      //是否是值得压缩的文本类型
+    char etag[48];          //由inode、大小和mtime生成的ETag，不含引号，压缩版本在后面加编码名
+    char last_modified[32]; //HTTP日期格式的mtime
+    char header[2][320];    //预先序列化的200响应头，不含状态行和Date，下标0为Connection:close，1为keep-alive
+    int header_len[2];      //两种响应头的长度
+    file_variant *variant[ENCODING_NUM];    //各编码的压缩版本，NULL表示还没有生成
+    long long charge;       //计入缓存预算的字节数，包括压缩版本
+    int ref;                //借用计数，缓存本身不计入
+    bool cached;            //是否还在缓存中，被淘汰或失效后由最后一个借用者释放
+    std::list<file_entry *>::iterator lru;  //在LRU链表中的位置
+};
+
+//file_cache类，进程内共享的静态文件缓存
+//按解析后的路径缓存stat结果和映射或描述符，连接借用缓存项而不是自己映射，命中时省去stat、open、mmap、munmap
+//总字节数超过预算时淘汰最久未用的文件，inotify监视文件所在目录，文件被修改、删除或替换时立即失效
+class file_cache {
+public:     //公有成员
+    static file_cache *get_instance();      //单例模式
+
+    void init(long long budget, int sendfile_threshold, int close_log);
+
+    file_entry *acquire(const char *path);
+
+    void release(file_entry *entry);
+
+    file_variant *encoded(file_entry *entry, int accept);
+
+    file_entry *lookup(const char *path);
+
+    static int format_etag(char *etag, int size, const struct stat &st);
+
+    static int format_http_date(char *date, int size, time_t t);
+
+    static bool etag_match(const char *list, const char *etag, int accept, int *encoding);
+
+    static std::string normalize(const char *path);
+
+private:    //私有成员
+    file_cache();
+
+    ~file_cache();
+
+    file_entry *find(const std::string &key);
+
+    file_entry *open_entry(const std::string &path);
+
+    void destroy(file_entry *entry);
+
+    static const char *content_type(const std::string &path);
+
+    static bool is_compressible(const char *type);
+
+    static int build_header(char *header, int size, const file_entry *entry, long long length,
+                            const char *encoding, bool linger);
+
+    file_variant *load_gz(file_entry *entry);
+
+    file_variant *compress(file_entry *entry, int encoding);
+
+    static void destroy_variant(file_variant *variant);
+
+    void remove(file_entry *entry);
+
+    void evict();
+
+    void watch(const std::string &path);
+
+    void invalidate(const std::string &path);
+
+    void invalidate_all();
+
+    static void *inotify_thread(void *arg);
+
+    void run();
+
+private:    //私有成员
+    locker m_lock;                                          //保护以下所有成员
+    std::unordered_map<std::string, file_entry *> m_entries;//路径到缓存项
+    std::list<file_entry *> m_lru;                          //表头为最近使用的缓存项
+    long long m_bytes;                                      //缓存项占用的总字节数
+    long long m_budget;                                     //字节预算，0表示不缓存
+    int m_sendfile_threshold;                               //不小于该大小的文件保存描述符，-1表示全部映射
+    int m_inotifyfd;                                        //inotify实例，-1表示不能自动失效
+    std::map<std::string, int> m_dir_wd;                    //已监视的目录到监视描述符
+    std::map<int, std::string> m_wd_dir;                    //监视描述符到目录
+    int m_close_log;                                        //是否关闭日志
+};
+
+#endif
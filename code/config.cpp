@@ -33,6 +33,48 @@ Config::Config() {
 
     //并发模型,默认是proactor
     actor_model = 0;
+
+    //子Reactor数量,默认0即单Reactor
+    reactor_num = 0;
+
+    //SO_REUSEPORT分片监听,默认不使用
+    reuseport = 0;
+
+    //I/O后端,默认是epoll
+    io_backend = 0;
+
+    //不小于64KB的文件用sendfile发送,-1表示不使用
+    sendfile_threshold = 64 * 1024;
+
+    //静态文件缓存64MB,0表示不缓存
+    file_cache_mb = 64;
+
+    //长连接空闲15秒后关闭
+    keepalive_timeout = 15;
+
+    //每个长连接最多处理1000个请求,0表示不限制
+    keepalive_requests = 1000;
+
+    //请求队列,默认工作窃取
+    queue_mode = 0;
+
+    //最多线程数,默认0即等于thread_num,线程数固定
+    thread_max = 0;
+
+    //任务排队超过20毫秒时增加线程
+    queue_wait_ms = 20;
+
+    //多出的线程空闲30秒后退出
+    thread_idle = 30;
+
+    //保留2个线程给静态请求,数据库变慢时登录注册最多占用其余的线程
+    static_reserved = 2;
+
+    //保留1个线程给数据库请求
+    db_reserved = 1;
+
+    //管理接口不保留线程,只是优先调度
+    admin_reserved = 0;
 }
 
 /**
@@ -42,7 +84,7 @@ Config::Config() {
  */
 void Config::parse_arg(int argc, char *argv[]) {
     int opt;
-    const char *str = "p:l:m:o:s:t:c:a:";
+    const char *str = "p:l:m:o:s:t:c:a:r:u:i:f:b:k:n:w:x:q:e:g:d:j:";
     while ((opt = getopt(argc, argv, str)) != -1) {
         switch (opt) {
             case 'p': {
@@ -77,8 +119,70 @@ void Config::parse_arg(int argc, char *argv[]) {
                 actor_model = atoi(optarg);
                 break;
             }
+            case 'r': {
+                reactor_num = atoi(optarg);
+                break;
+            }
+            case 'u': {
+                reuseport = atoi(optarg);
+                break;
+            }
+            case 'i': {
+                io_backend = atoi(optarg);
+                break;
+            }
+            case 'f': {
+                sendfile_threshold = atoi(optarg);
+                break;
+            }
+            case 'b': {
+                file_cache_mb = atoi(optarg);
+                break;
+            }
+            case 'k': {
+                keepalive_timeout = atoi(optarg);
+                break;
+            }
+            case 'n': {
+                keepalive_requests = atoi(optarg);
+                break;
+            }
+            case 'w': {
+                queue_mode = atoi(optarg);
+                break;
+            }
+            case 'x': {
+                thread_max = atoi(optarg);
+                break;
+            }
+            case 'q': {
+                queue_wait_ms = atoi(optarg);
+                break;
+            }
+            case 'e': {
+                thread_idle = atoi(optarg);
+                break;
+            }
+            case 'g': {
+                static_reserved = atoi(optarg);
+                break;
+            }
+            case 'd': {
+                db_reserved = atoi(optarg);
+                break;
+            }
+            case 'j': {
+                admin_reserved = atoi(optarg);
+                break;
+            }
             default:
                 break;
         }
     }
+
+    //SO_REUSEPORT分片由子Reactor各自监听，单Reactor时没有可以分片的线程，直接报错而不是悄悄忽略
+    if (reuseport && reactor_num <= 0) {
+        fprintf(stderr, "-u %d requires -r N with N > 0 sub reactors\n", reuseport);
+        exit(1);
+    }
 }
\ No newline at end of file
@@ -43,6 +43,48 @@ public:     //公有成员
 
     //并发模型选择
     int actor_model;
+
+    //子Reactor数量
+    int reactor_num;
+
+    //SO_REUSEPORT分片监听模式
+    int reuseport;
+
+    //I/O后端选择
+    int io_backend;
+
+    //使用sendfile发送的文件大小阈值
+    int sendfile_threshold;
+
+    //静态文件缓存的容量,单位MB
+    int file_cache_mb;
+
+    //长连接空闲超时,单位秒
+    int keepalive_timeout;
+
+    //每个长连接最多处理的请求数
+    int keepalive_requests;
+
+    //线程池请求队列的调度方式
+    int queue_mode;
+
+    //线程池最多的线程数
+    int thread_max;
+
+    //线程池的排队时间目标,单位毫秒
+    int queue_wait_ms;
+
+    //多出的线程的空闲超时,单位秒
+    int thread_idle;
+
+    //给静态请求保留的线程数
+    int static_reserved;
+
+    //给数据库请求保留的线程数
+    int db_reserved;
+
+    //给管理接口保留的线程数
+    int admin_reserved;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "buffer_pool.h"
+
+/**
+ * @brief 单例模式，第一次使用时创建
+ * @return
+ */
+buffer_pool *buffer_pool::get_instance() {
+    static buffer_pool pool;
+    return &pool;
+}
+
+buffer_pool::buffer_pool() {
+}
+
+/**
+ * @brief 析构函数，释放所有空闲块
+ */
+buffer_pool::~buffer_pool() {
+    for (int i = 0; i < CLASS_NUM; ++i) {
+        for (size_t j = 0; j < m_free[i].size(); ++j)
+            free(m_free[i][j]);
+    }
+}
+
+/**
+ * @brief 能容纳size字节的最小级别
+ * @param size
+ * @return 超过最大块时返回-1
+ */
+int buffer_pool::size_class(int size) {
+    int shift = MIN_BLOCK_SHIFT;
+    while (shift <= MAX_BLOCK_SHIFT && (1 << shift) < size)
+        ++shift;
+    return shift > MAX_BLOCK_SHIFT ? -1 : shift - MIN_BLOCK_SHIFT;
+}
+
+/**
+ * @brief 借出一块至少size字节的缓冲区
+ * @param size
+ * @param block_size 返回块的实际大小，归还时原样传回
+ * @return size超过最大块时返回NULL
+ */
+char *buffer_pool::get(int size, int *block_size) {
+    int c = size_class(size);
+    if (c < 0)
+        return NULL;
+    *block_size = 1 << (c + MIN_BLOCK_SHIFT);
+
+    char *block = NULL;
+    m_lock[c].lock();
+    if (!m_free[c].empty()) {
+        block = m_free[c].back();
+        m_free[c].pop_back();
+    }
+    m_lock[c].unlock();
+
+    if (!block) {
+        block = (char *) malloc(*block_size);
+        if (!block)
+            throw std::exception();
+    }
+    return block;
+}
+
+/**
+ * @brief 归还get借出的块
+ * @param block
+ * @param block_size
+ */
+void buffer_pool::put(char *block, int block_size) {
+    int c = size_class(block_size);
+    assert(c >= 0 && (1 << (c + MIN_BLOCK_SHIFT)) == block_size);
+
+    m_lock[c].lock();
+    if ((int) m_free[c].size() < MAX_IDLE) {
+        m_free[c].push_back(block);
+        block = NULL;
+    }
+    m_lock[c].unlock();
+
+    if (block)
+        free(block);
+}
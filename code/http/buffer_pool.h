@@ -0,0 +1,41 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stdlib.h>
+#include <assert.h>
+#include <vector>
+#include <exception>
+
+#include "../lock/locker.h"
+
+//buffer_pool类，进程内共享的读缓冲区块池
+//请求超出连接自带的读缓冲区时从这里借一块更大的，请求处理完毕或连接关闭后归还，大请求不必让每个连接都常驻大缓冲区
+//块大小按2的幂分级，每级一个空闲栈，各级分别加锁
+class buffer_pool {
+public:     //公有成员
+    static const int MIN_BLOCK_SHIFT = 12;  //最小的块4KB
+    static const int MAX_BLOCK_SHIFT = 20;  //最大的块1MB，也是单个请求的大小上限
+    static const int MAX_BLOCK_SIZE = 1 << MAX_BLOCK_SHIFT;
+    static const int MAX_IDLE = 64;         //每级最多缓存的空闲块数，多余的直接释放
+
+    static buffer_pool *get_instance();     //单例模式
+
+    char *get(int size, int *block_size);
+
+    void put(char *block, int block_size);
+
+private:    //私有成员
+    static const int CLASS_NUM = MAX_BLOCK_SHIFT - MIN_BLOCK_SHIFT + 1;
+
+    buffer_pool();
+
+    ~buffer_pool();
+
+    static int size_class(int size);
+
+private:    //私有成员
+    locker m_lock[CLASS_NUM];               //保护对应级别的空闲栈
+    std::vector<char *> m_free[CLASS_NUM];  //各级空闲块
+};
+
+#endif
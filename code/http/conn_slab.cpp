@@ -0,0 +1,111 @@
+#include "conn_slab.h"
+
+/**
+ * @brief 构造函数，第一个连接到来时才分配内存
+ */
+conn_slab::conn_slab() {
+    m_live = 0;
+    m_free = 0;
+}
+
+/**
+ * @brief 析构函数，释放所有块
+ */
+conn_slab::~conn_slab() {
+    std::map<http_conn *, slab *>::iterator it;
+    for (it = m_slabs.begin(); it != m_slabs.end(); ++it) {
+        slab *s = it->second;
+        for (int i = 0; i < SLAB_SIZE; ++i)
+            s->conns[i].~http_conn();
+        munmap(s->conns, sizeof(http_conn) * SLAB_SIZE);
+        delete s;
+    }
+}
+
+/**
+ * @brief 映射一块新的连接对象，页面在第一次访问时才占用物理内存
+ * @return
+ */
+conn_slab::slab *conn_slab::new_slab() {
+    void *mem = mmap(NULL, sizeof(http_conn) * SLAB_SIZE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        throw std::exception();
+
+    slab *s = new slab;
+    s->conns = (http_conn *) mem;
+    for (int i = 0; i < SLAB_SIZE; ++i) {
+        new(&s->conns[i]) http_conn();
+        //倒序压栈，先分配低地址的对象
+        s->free[i] = &s->conns[SLAB_SIZE - 1 - i];
+    }
+    s->free_num = SLAB_SIZE;
+    s->partial = true;
+
+    m_slabs[s->conns] = s;
+    m_partial.push_back(s);
+    m_free += SLAB_SIZE;
+    return s;
+}
+
+/**
+ * @brief 释放一块完全空闲的连接对象
+ * @param s
+ */
+void conn_slab::delete_slab(slab *s) {
+    for (size_t i = 0; i < m_partial.size(); ++i) {
+        if (m_partial[i] == s) {
+            m_partial[i] = m_partial.back();
+            m_partial.pop_back();
+            break;
+        }
+    }
+    m_slabs.erase(s->conns);
+    m_free -= SLAB_SIZE;
+
+    for (int i = 0; i < SLAB_SIZE; ++i)
+        s->conns[i].~http_conn();
+    munmap(s->conns, sizeof(http_conn) * SLAB_SIZE);
+    delete s;
+}
+
+/**
+ * @brief 分配一个连接对象，优先使用最近有空闲位置的块
+ * @return
+ */
+http_conn *conn_slab::alloc() {
+    //丢掉已经被分配满的块
+    while (!m_partial.empty() && 0 == m_partial.back()->free_num) {
+        m_partial.back()->partial = false;
+        m_partial.pop_back();
+    }
+    slab *s = m_partial.empty() ? new_slab() : m_partial.back();
+
+    http_conn *conn = s->free[--s->free_num];
+    --m_free;
+    ++m_live;
+    return conn;
+}
+
+/**
+ * @brief 把连接对象放回所在的块，整块空闲且还有至少一整块空闲对象时释放该块，避免连接数在边界附近抖动时反复映射
+ * @param conn
+ */
+void conn_slab::release(http_conn *conn) {
+    std::map<http_conn *, slab *>::iterator it = m_slabs.upper_bound(conn);
+    assert(it != m_slabs.begin());
+    slab *s = (--it)->second;
+
+    //空闲的连接对象不占用借来的读缓冲区和文件映射
+    conn->release();
+    s->free[s->free_num++] = conn;
+    ++m_free;
+    --m_live;
+    if (!s->partial) {
+        s->partial = true;
+        m_partial.push_back(s);
+    }
+
+    if (SLAB_SIZE == s->free_num && m_free - SLAB_SIZE >= SLAB_SIZE)
+        delete_slab(s);
+}
@@ -0,0 +1,49 @@
+#ifndef CONN_SLAB_H
+#define CONN_SLAB_H
+
+#include <sys/mman.h>
+#include <new>
+#include <map>
+#include <vector>
+#include <exception>
+
+#include "http_conn.h"
+
+//conn_slab类，每个事件循环一个的http_conn对象池
+//按块分配连接对象，新连接从有空闲位置的块中取，关闭后放回所在的块，整块空闲时归还给系统，内存随在线连接数增减
+//只在所属事件循环的线程中分配和释放，不需要加锁
+class conn_slab {
+public:     //公有成员
+    static const int SLAB_SIZE = 64;    //每块的连接对象数
+
+    conn_slab();
+
+    ~conn_slab();
+
+    http_conn *alloc();
+
+    void release(http_conn *conn);
+
+    int live() const { return m_live; }
+
+private:    //私有成员
+    //一块连接对象，直接mmap得到，释放时munmap立即归还物理内存
+    struct slab {
+        http_conn *conns;               //SLAB_SIZE个连接对象
+        http_conn *free[SLAB_SIZE];     //块内空闲对象栈
+        int free_num;                   //块内空闲对象数
+        bool partial;                   //是否在有空闲位置的块列表中
+    };
+
+    slab *new_slab();
+
+    void delete_slab(slab *s);
+
+private:    //私有成员
+    std::map<http_conn *, slab *> m_slabs;  //块起始地址到块的映射，用来找到对象所在的块
+    std::vector<slab *> m_partial;          //有空闲位置的块
+    int m_live;                             //在用的连接对象数
+    int m_free;                             //所有块中空闲的连接对象数
+};
+
+#endif
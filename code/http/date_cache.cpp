@@ -0,0 +1,41 @@
+#include "date_cache.h"
+
+/**
+ * @brief 单例模式，第一次使用时创建
+ * @return
+ */
+date_cache *date_cache::get_instance() {
+    static date_cache cache;
+    return &cache;
+}
+
+/**
+ * @brief 构造函数，立即生成一次，事件循环开始前的响应也有Date
+ */
+date_cache::date_cache() : m_now(0), m_cur(0) {
+    memset(m_line, 0, sizeof(m_line));
+    refresh();
+}
+
+date_cache::~date_cache() {
+}
+
+/**
+ * @brief 秒数变化时重新格式化Date行，同一秒内的调用只是一次比较
+ */
+void date_cache::refresh() {
+    time_t now = time(NULL);
+    if (now == m_now.load(std::memory_order_relaxed))
+        return;
+
+    m_lock.lock();
+    if (now != m_now.load(std::memory_order_relaxed)) {
+        int next = 1 - m_cur.load(std::memory_order_relaxed);
+        struct tm tm;
+        gmtime_r(&now, &tm);
+        strftime(m_line[next], sizeof(m_line[next]), "Date:%a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+        m_cur.store(next, std::memory_order_release);
+        m_now.store(now, std::memory_order_relaxed);
+    }
+    m_lock.unlock();
+}
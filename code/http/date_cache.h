@@ -0,0 +1,39 @@
+#ifndef DATE_CACHE_H
+#define DATE_CACHE_H
+
+#include <time.h>
+#include <string.h>
+#include <atomic>
+
+#include "../lock/locker.h"
+
+//date_cache类，进程内共享的Date响应头
+//每秒最多格式化一次，事件循环每次醒来时调用refresh，生成响应时只复制格式化好的一行
+//两个缓冲区交替使用，刷新时写另一个再切换，读者不加锁
+class date_cache {
+public:     //公有成员
+    static const int LINE_LEN = 36;         //"Date:Tue, 07 Mar 2023 01:45:15 GMT\r\n"的长度
+
+    static date_cache *get_instance();      //单例模式
+
+    void refresh();
+
+    //把当前的Date行复制到buf，返回LINE_LEN；刷新两次才会覆盖正在读的缓冲区，复制期间不会发生
+    int copy(char *buf) const {
+        memcpy(buf, m_line[m_cur.load(std::memory_order_acquire)], LINE_LEN);
+        return LINE_LEN;
+    }
+
+private:    //私有成员
+    date_cache();
+
+    ~date_cache();
+
+private:    //私有成员
+    locker m_lock;                      //多个事件循环同时刷新时只让一个写
+    std::atomic<time_t> m_now;          //当前Date行对应的秒数
+    std::atomic<int> m_cur;             //读者使用的缓冲区下标
+    char m_line[2][LINE_LEN + 1];       //交替使用的两个Date行
+};
+
+#endif
@@ -1,10 +1,14 @@
 #include "http_conn.h"
+#include "router.h"
 
 #include <mysql/mysql.h>
 #include <fstream>
 
 //定义http响应的一些状态信息
 const char *ok_200_title = "OK";
+const char *partial_206_title = "Partial Content";
+const char *not_modified_304_title = "Not Modified";
+const char *error_416_title = "Range Not Satisfiable";
 const char *error_400_title = "Bad Request";
 const char *error_400_form = "Your request has bad syntax or is inherently impossible to staisfy.\n";
 const char *error_403_title = "Forbidden";
@@ -14,6 +18,39 @@ const char *error_404_form = "The requested file was not found on this server.\n
 const char *error_500_title = "Internal Error";
 const char *error_500_form = "There was an unusual problem serving the request file.\n";
 
+//预先生成的错误响应，状态行和Date之后的头部连同正文是常量，按是否保持连接各一份，直接作为iovec发送
+struct error_response {
+    int status;
+    const char *title;
+    const char *form;
+    char tail[2][256];
+    int tail_len[2];
+};
+
+static error_response error_responses[] = {
+        {400, error_400_title, error_400_form},
+        {403, error_403_title, error_403_form},
+        {404, error_404_title, error_404_form},
+        {500, error_500_title, error_500_form},
+};
+
+/**
+ * @brief 启动时生成各错误响应的常量部分
+ * @return
+ */
+static bool build_error_responses() {
+    for (size_t i = 0; i < sizeof(error_responses) / sizeof(error_responses[0]); ++i) {
+        error_response &error = error_responses[i];
+        for (int linger = 0; linger < 2; ++linger)
+            error.tail_len[linger] = snprintf(error.tail[linger], sizeof(error.tail[linger]),
+                                              "Content-Length:%d\r\nContent-Type:text/html\r\nConnection:%s\r\n\r\n%s",
+                                              (int) strlen(error.form), linger ? "keep-alive" : "close", error.form);
+    }
+    return true;
+}
+
+static bool error_responses_built = build_error_responses();
+
 locker m_lock;
 map <string, string> users;
 
@@ -48,84 +85,7 @@ void http_conn::initmysql_result(connection_pool *connPool) {
     }
 }
 
-/**
- * @brief 对文件描述符设置非阻塞
- * @param fd
- * @return
- */
-int setnonblocking(int fd) {
-    int old_option = fcntl(fd, F_GETFL);
-    int new_option = old_option | O_NONBLOCK;
-    fcntl(fd, F_SETFL, new_option);
-    return old_option;
-}
-
-/**
- * @brief 将内核事件表注册读事件，ET模式，选择开启EPOLLONESHOT
- * @param epollfd
- * @param fd
- * @param one_shot
- * @param TRIGMode
- */
-void addfd(int epollfd, int fd, bool one_shot, int TRIGMode) {
-    epoll_event event;
-    event.data.fd = fd;
-
-    if (1 == TRIGMode)
-        event.events = EPOLLIN | EPOLLET | EPOLLRDHUP;
-    else
-        event.events = EPOLLIN | EPOLLRDHUP;
-
-    if (one_shot)
-        event.events |= EPOLLONESHOT;
-    epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
-    setnonblocking(fd);
-}
-
-/**
- * @brief 从内核时间表删除描述符
- * @param epollfd
- * @param fd
- */
-void removefd(int epollfd, int fd) {
-    epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, 0);
-    close(fd);
-}
-
-/**
- * @brief 将事件重置为EPOLLONESHOT
- * @param epollfd
- * @param fd
- * @param ev
- * @param TRIGMode
- */
-void modfd(int epollfd, int fd, int ev, int TRIGMode) {
-    epoll_event event;
-    event.data.fd = fd;
-
-    if (1 == TRIGMode)
-        event.events = ev | EPOLLET | EPOLLONESHOT | EPOLLRDHUP;
-    else
-        event.events = ev | EPOLLONESHOT | EPOLLRDHUP;
-
-    epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);
-}
-
-int http_conn::m_user_count = 0;
-int http_conn::m_epollfd = -1;
-
-/**
- * @brief 关闭连接，关闭一个连接，客户总量减一
- * @param real_close
- */
-void http_conn::close_conn(bool real_close) {
-    if (real_close && (m_sockfd != -1)) {
-        printf("close %d\n", m_sockfd);
-        removefd(m_epollfd, m_sockfd);
-        m_sockfd = -1;
-        m_user_count--;
-    }
-}
+std::atomic<int> http_conn::m_user_count(0);
 
 /**
  * @brief 初始化连接,外部调用初始化套接字地址
@@ -134,59 +94,179 @@ void http_conn::close_conn(bool real_close) {
  * @param root
  * @param TRIGMode
  * @param close_log
- * @param user
- * @param passwd
- * @param sqlname
+ * @param backend 连接所属事件循环的I/O后端
+ * @param cq 连接所属事件循环的完成队列
+ * @param max_requests 本连接最多处理的请求数，0表示不限制
  */
 void http_conn::init(int sockfd, const sockaddr_in &addr, char *root, int TRIGMode,
-                     int close_log, string user, string passwd, string sqlname) {
+                     int close_log, event_backend *backend, completion_queue *cq, int max_requests) {
     m_sockfd = sockfd;
     m_address = addr;
-
-    addfd(m_epollfd, sockfd, true, m_TRIGMode);
-    m_user_count++;
+    m_backend = backend;
+    m_cq = cq;
 
     //当浏览器出现连接重置时，可能是网站根目录出错或http响应格式出错或者访问的文件中内容完全为空
     doc_root = root;
     m_TRIGMode = TRIGMode;
     m_close_log = close_log;
+    m_max_requests = max_requests;
+    ++m_generation;
 
-    strcpy(sql_user, user.c_str());
-    strcpy(sql_passwd, passwd.c_str());
-    strcpy(sql_name, sqlname.c_str());
+    m_backend->addfd(sockfd, this, true, m_TRIGMode);
+    m_user_count++;
 
     init();
 }
 
+/**
+ * @brief 工作线程处理完一个任务后调用，解除占用并通知所属事件循环
+ * 调用之后不能再访问本对象，事件循环可能已经关闭并复用了该连接
+ * @param close 读写失败，需要事件循环删除定时器并关闭连接
+ */
+void http_conn::post_completion(bool close) {
+    //解除占用之后空闲定时器就可能回收本对象，先取出完成队列和代数
+    completion_queue *cq = m_cq;
+    unsigned generation = m_generation;
+    int prev = m_inflight.fetch_sub(1, std::memory_order_acq_rel);
+    //占用期间事件循环要求过关闭，最后一个处理完的任务通知它立即关闭
+    if ((CLOSE_PENDING | 1) == prev)
+        close = true;
+    //成功的读写不需要事件循环做任何处理
+    if (close)
+        cq->push(this, generation, close);
+}
+
+/**
+ * @brief 事件循环关闭连接之前调用，连接被占用时记下关闭请求，由最后一个处理完的任务通过完成队列再次通知
+ * 工作线程可能先重新注册了读写事件再解除占用，事件循环这时发完响应要关闭连接，不能等到空闲超时
+ * @return 连接还被占用，现在不能关闭
+ */
+bool http_conn::defer_close() {
+    int prev = m_inflight.fetch_or(CLOSE_PENDING, std::memory_order_acq_rel);
+    if (prev & ~CLOSE_PENDING)
+        return true;
+    m_inflight.store(0, std::memory_order_relaxed);
+    return false;
+}
+
 /**
  * @brief 初始化新接受的连接
  * check_state默认为分析请求行状态
  */
 void http_conn::init() {
-    mysql = NULL;
     bytes_to_send = 0;
     bytes_have_send = 0;
     m_check_state = CHECK_STATE_REQUESTLINE;
     m_linger = false;
+    m_accept_encoding = 0;
+    m_if_modified_since = -1;
+    m_etag_encoding = -1;
+    m_keep_alive = false;
+    m_request_count = 0;
+    m_pipelined = false;
+    m_deferred = NO_REQUEST;
+    m_linked = false;
     m_method = GET;
     m_url = 0;
     m_version = 0;
     m_content_length = 0;
-    m_host = 0;
+    m_header_count = 0;
+    m_header_mask = 0;
     m_start_line = 0;
     m_checked_idx = 0;
     m_read_idx = 0;
     m_write_idx = 0;
-    cgi = 0;
+    m_iv_count = 0;
+    m_iv_idx = 0;
+    m_file_count = 0;
+    m_file = NULL;
+    m_send_fd = -1;
+    m_seg_count = 0;
+    m_seg_idx = 0;
+    m_string = NULL;
     m_state = 0;
-    timer_flag = 0;
-    improv = 0;
 
     memset(m_read_buf, '\0', READ_BUFFER_SIZE);
     memset(m_write_buf, '\0', WRITE_BUFFER_SIZE);
     memset(m_real_file, '\0', FILENAME_LEN);
 }
 
+/**
+ * @brief 一个请求的响应生成之后调用，准备解析同一连接上的下一个请求
+ * 读缓冲区中剩余的流水线数据移到开头，不能像init()那样清空，否则已经收到的后续请求会丢失
+ */
+void http_conn::next_request() {
+    //恢复parse_content截断请求体时改写的字节，它属于下一个请求
+    if (m_check_state == CHECK_STATE_CONTENT)
+        m_read_buf[m_checked_idx] = m_body_next;
+
+    int left = m_read_idx - m_checked_idx;
+    if (left > 0)
+        memmove(m_read_buf, m_read_buf + m_checked_idx, left);
+    m_read_idx = left;
+    m_checked_idx = 0;
+    m_start_line = 0;
+    shrink_read_buf();
+
+    m_check_state = CHECK_STATE_REQUESTLINE;
+    m_linger = false;
+    m_accept_encoding = 0;
+    m_if_modified_since = -1;
+    m_etag_encoding = -1;
+    m_method = GET;
+    m_url = 0;
+    m_version = 0;
+    m_content_length = 0;
+    m_header_count = 0;
+    m_header_mask = 0;
+    m_string = NULL;
+    memset(m_real_file, '\0', FILENAME_LEN);
+}
+
+/**
+ * @brief 一批响应全部发送完毕后重置写状态
+ */
+void http_conn::reset_write() {
+    m_write_idx = 0;
+    m_iv_count = 0;
+    m_iv_idx = 0;
+    bytes_to_send = 0;
+    bytes_have_send = 0;
+    m_seg_count = 0;
+    m_seg_idx = 0;
+}
+
+/**
+ * @brief 把一段响应数据追加到待发送的iovec末尾，和上一段内存相邻时直接合并
+ * @param base
+ * @param len
+ */
+void http_conn::add_iov(char *base, size_t len) {
+    //中间夹着sendfile段的两个iovec即使地址相邻也不能合并
+    bool segment = m_seg_count > 0 && m_segs[m_seg_count - 1].iv_end == m_iv_count;
+    if (m_iv_count > 0 && !segment && (char *) m_iv[m_iv_count - 1].iov_base + m_iv[m_iv_count - 1].iov_len == base) {
+        m_iv[m_iv_count - 1].iov_len += len;
+    } else {
+        m_iv[m_iv_count].iov_base = base;
+        m_iv[m_iv_count].iov_len = len;
+        ++m_iv_count;
+    }
+    bytes_to_send += len;
+}
+
+/**
+ * @brief 在当前的iovec之后追加一段用sendfile发送的文件，文件描述符为m_send_fd
+ * @param offset
+ * @param end
+ */
+void http_conn::add_segment(off_t offset, off_t end) {
+    send_segment &seg = m_segs[m_seg_count++];
+    seg.iv_end = m_iv_count;
+    seg.offset = offset;
+    seg.end = end;
+    bytes_to_send += end - offset;
+}
+
 
 /**
  * @brief 从状态机，用于分析出一行内容
@@ -194,46 +274,89 @@ void http_conn::init() {
  * @return
  */
 http_conn::LINE_STATUS http_conn::parse_line() {
-    char temp;
-    for (; m_checked_idx < m_read_idx; ++m_checked_idx) {
-        temp = m_read_buf[m_checked_idx];
-        if (temp == '\r') {
-            if ((m_checked_idx + 1) == m_read_idx)
-                return LINE_OPEN;
-            else if (m_read_buf[m_checked_idx + 1] == '\n') {
-                m_read_buf[m_checked_idx++] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
-        } else if (temp == '\n') {
-            if (m_checked_idx > 1 && m_read_buf[m_checked_idx - 1] == '\r') {
-                m_read_buf[m_checked_idx - 1] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
+    //向量化地跳过普通字节，只在'\r'或'\n'处判断
+    const char *end = m_read_buf + m_read_idx;
+    const char *p = http_scanner::find(m_read_buf + m_checked_idx, end, '\r', '\n');
+    m_checked_idx = p - m_read_buf;
+    if (p == end)
+        return LINE_OPEN;
+    if (*p == '\r') {
+        if ((m_checked_idx + 1) == m_read_idx)
+            return LINE_OPEN;
+        else if (m_read_buf[m_checked_idx + 1] == '\n') {
+            m_read_buf[m_checked_idx++] = '\0';
+            m_read_buf[m_checked_idx++] = '\0';
+            return LINE_OK;
         }
+        return LINE_BAD;
     }
-    return LINE_OPEN;
+    if (m_checked_idx > 1 && m_read_buf[m_checked_idx - 1] == '\r') {
+        m_read_buf[m_checked_idx - 1] = '\0';
+        m_read_buf[m_checked_idx++] = '\0';
+        return LINE_OK;
+    }
+    return LINE_BAD;
 }
 
 
+/**
+ * @brief 一次readv读取客户数据，放不下的部分先读进线程私有的溢出区，再拷贝到扩大后的读缓冲区
+ * 这样一次系统调用就能把套接字中的数据取完，连接自带的缓冲区不必按最大请求分配
+ * @return 同recv，出错时保留errno
+ */
+int http_conn::read_some() {
+    static thread_local char overflow[OVERFLOW_SIZE];
+
+    //最后一个字节留给parse_content截断请求体
+    int space = m_read_size - 1 - m_read_idx;
+    struct iovec iv[2];
+    iv[0].iov_base = m_read_buf + m_read_idx;
+    iv[0].iov_len = space;
+    iv[1].iov_base = overflow;
+    iv[1].iov_len = OVERFLOW_SIZE;
+    //溢出区的数据必须能放进扩大后的读缓冲区
+    if (iv[1].iov_len > (size_t) (buffer_pool::MAX_BLOCK_SIZE - m_read_size))
+        iv[1].iov_len = buffer_pool::MAX_BLOCK_SIZE - m_read_size;
+
+    int bytes_read = m_backend->readv(m_sockfd, iv, iv[1].iov_len > 0 ? 2 : 1);
+    if (bytes_read <= space) {
+        if (bytes_read > 0)
+            m_read_idx += bytes_read;
+        return bytes_read;
+    }
+
+    m_read_idx += space;
+    int extra = bytes_read - space;
+    if (!grow_read_buf(m_read_idx + extra + 1)) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    memcpy(m_read_buf + m_read_idx, overflow, extra);
+    m_read_idx += extra;
+    return bytes_read;
+}
+
 /**
  * @brief 循环读取客户数据，直到无数据可读或对方关闭连接
  * 非阻塞ET工作模式下，需要一次性将数据读完
  * @return
  */
 bool http_conn::read_once() {
-    if (m_read_idx >= READ_BUFFER_SIZE) {
+    //异步发送全部完成后后端才会接收下一个请求，这时归还这一批响应借用的文件
+    if (m_linked) {
+        m_linked = false;
+        unmap();
+        reset_write();
+    }
+    //读缓冲区已满，且已经扩大到上限还放不下一个完整请求
+    if (m_read_idx >= m_read_size - 1 && !grow_read_buf(m_read_size + 1)) {
         return false;
     }
     int bytes_read = 0;
 
     //LT读取数据
     if (0 == m_TRIGMode) {
-        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
-        m_read_idx += bytes_read;
+        bytes_read = read_some();
 
         if (bytes_read <= 0) {
             return false;
@@ -244,7 +367,7 @@ bool http_conn::read_once() {
         //ET读数据
     else {
         while (true) {
-            bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
+            bytes_read = read_some();
             if (bytes_read == -1) {
                 if (errno == EAGAIN || errno == EWOULDBLOCK)
                     break;
@@ -252,38 +375,99 @@ bool http_conn::read_once() {
             } else if (bytes_read == 0) {
                 return false;
             }
-            m_read_idx += bytes_read;
+            //缓冲区已经扩大到上限时先处理已读到的请求，重新注册EPOLLIN时内核中剩下的数据会再次触发读事件
+            if (m_read_idx >= m_read_size - 1 && !grow_read_buf(m_read_size + 1))
+                break;
         }
         return true;
     }
 }
 
+/**
+ * @brief 把读缓冲区扩大到至少size字节，已解析出的指针随数据一起搬到新缓冲区
+ * @param size
+ * @return 超过单个请求的上限时返回false
+ */
+bool http_conn::grow_read_buf(int size) {
+    if (size <= m_read_size)
+        return true;
+    int block_size = 0;
+    char *block = buffer_pool::get_instance()->get(size, &block_size);
+    if (!block)
+        return false;
+
+    char *old = m_read_buf;
+    memcpy(block, old, m_read_idx);
+    //请求行和头部可能已经解析了一部分，指向旧缓冲区的指针要换到新缓冲区
+    if (m_url)
+        m_url = block + (m_url - old);
+    if (m_version)
+        m_version = block + (m_version - old);
+    //头部索引用的是偏移，不需要调整
+
+    if (old != m_inline_buf)
+        buffer_pool::get_instance()->put(old, m_read_size);
+    m_read_buf = block;
+    m_read_size = block_size;
+    return true;
+}
+
+/**
+ * @brief 请求处理完毕后，剩余数据放得进连接自带的缓冲区时归还借来的块
+ * 只在请求之间调用，此时没有指向读缓冲区的指针
+ */
+void http_conn::shrink_read_buf() {
+    if (m_read_buf == m_inline_buf || m_read_idx >= READ_BUFFER_SIZE)
+        return;
+    memcpy(m_inline_buf, m_read_buf, m_read_idx);
+    buffer_pool::get_instance()->put(m_read_buf, m_read_size);
+    m_read_buf = m_inline_buf;
+    m_read_size = READ_BUFFER_SIZE;
+}
+
+/**
+ * @brief 连接关闭、对象放回连接池之前调用，归还借来的读缓冲区并释放还没发送的文件映射
+ */
+void http_conn::release() {
+    m_read_idx = 0;
+    shrink_read_buf();
+    unmap();
+    if (m_file) {
+        file_cache::get_instance()->release(m_file);
+        m_file = NULL;
+    }
+}
+
 /**
  * @brief 解析http请求行，获得请求方法，目标url及http版本号
  * @param text
  * @return
  */
-http_conn::HTTP_CODE http_conn::parse_request_line(char *text) {
-    m_url = strpbrk(text, " \t");
-    if (!m_url) {
+http_conn::HTTP_CODE http_conn::parse_request_line(char *text, char *end) {
+    m_url = (char *) http_scanner::find(text, end, ' ', '\t');
+    if (m_url == end) {
         return BAD_REQUEST;
     }
     *m_url++ = '\0';
     char *method = text;
     if (strcasecmp(method, "GET") == 0)
         m_method = GET;
-    else if (strcasecmp(method, "POST") == 0) {
+    else if (strcasecmp(method, "POST") == 0)
         m_method = POST;
-        cgi = 1;
-    } else
+    else
         return BAD_REQUEST;
     m_url += strspn(m_url, " \t");
-    m_version = strpbrk(m_url, " \t");
-    if (!m_version)
+    m_version = (char *) http_scanner::find(m_url, end, ' ', '\t');
+    if (m_version == end)
         return BAD_REQUEST;
     *m_version++ = '\0';
     m_version += strspn(m_version, " \t");
-    if (strcasecmp(m_version, "HTTP/1.1") != 0)
+    //HTTP/1.1默认保持连接，HTTP/1.0默认短连接，Connection头部可以改变默认值
+    if (strcasecmp(m_version, "HTTP/1.1") == 0)
+        m_linger = true;
+    else if (strcasecmp(m_version, "HTTP/1.0") == 0)
+        m_linger = false;
+    else
         return BAD_REQUEST;
     if (strncasecmp(m_url, "http://", 7) == 0) {
         m_url += 7;
@@ -297,9 +481,6 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text) {
 
     if (!m_url || m_url[0] != '/')
         return BAD_REQUEST;
-    //当url为/时，显示判断界面
-    if (strlen(m_url) == 1)
-        strcat(m_url, "judge.html");
     m_check_state = CHECK_STATE_HEADER;
     return NO_REQUEST;
 }
@@ -309,33 +490,158 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text) {
  * @param text
  * @return
  */
-http_conn::HTTP_CODE http_conn::parse_headers(char *text) {
-    if (text[0] == '\0') {
+http_conn::HTTP_CODE http_conn::parse_headers(char *text, char *end) {
+    if (text == end) {
         if (m_content_length != 0) {
             m_check_state = CHECK_STATE_CONTENT;
             return NO_REQUEST;
         }
         return GET_REQUEST;
-    } else if (strncasecmp(text, "Connection:", 11) == 0) {
-        text += 11;
-        text += strspn(text, " \t");
-        if (strcasecmp(text, "keep-alive") == 0) {
-            m_linger = true;
+    }
+
+    //冒号之前是头部名称，值去掉首尾空白后和名称一起记入头部索引
+    char *colon = (char *) http_scanner::find(text, end, ':', ':');
+    if (colon == end || colon == text) {
+        LOG_INFO("bad header line: %s", text);
+        return NO_REQUEST;
+    }
+    if (m_header_count == MAX_HEADERS)
+        return BAD_REQUEST;
+    int name_len = colon - text;
+    char *value = colon + 1;
+    value += strspn(value, " \t");
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t'))
+        --end;
+    *end = '\0';
+    header_field &field = m_headers[m_header_count++];
+    field.name = text - m_read_buf;
+    field.name_len = name_len;
+    field.value = value - m_read_buf;
+    field.value_len = end - value;
+
+    //常用头部按完美哈希得到编号，同名头部以第一个为准；其它头部只留在索引中，不再写日志
+    field.id = http_header::lookup(text, name_len);
+    if (field.id == HEADER_UNKNOWN)
+        return NO_REQUEST;
+    if (!(m_header_mask & (1u << field.id))) {
+        m_header_mask |= 1u << field.id;
+        m_header_idx[field.id] = m_header_count - 1;
+    }
+    switch (field.id) {
+        case HEADER_CONNECTION: {
+            parse_connection(value);
+            break;
         }
-    } else if (strncasecmp(text, "Content-length:", 15) == 0) {
-        text += 15;
-        text += strspn(text, " \t");
-        m_content_length = atol(text);
-    } else if (strncasecmp(text, "Host:", 5) == 0) {
-        text += 5;
-        text += strspn(text, " \t");
-        m_host = text;
-    } else {
-        LOG_INFO("oop!unknow header: %s", text);
+        case HEADER_CONTENT_LENGTH: {
+            //只接受十进制数字，负数、溢出或者超过单个请求的上限时解析游标会越界，按错误请求处理
+            char *digits_end = NULL;
+            errno = 0;
+            long length = isdigit((unsigned char) value[0]) ? strtol(value, &digits_end, 10) : -1;
+            if (length < 0 || errno == ERANGE || *digits_end != '\0' || length > buffer_pool::MAX_BLOCK_SIZE)
+                return BAD_REQUEST;
+            m_content_length = length;
+            break;
+        }
+        case HEADER_ACCEPT_ENCODING: {
+            parse_accept_encoding(value);
+            break;
+        }
+        case HEADER_IF_MODIFIED_SINCE: {
+            //只接受IMF-fixdate格式，无法解析时当作没有这个头部
+            struct tm tm;
+            memset(&tm, 0, sizeof(tm));
+            const char *date_end = strptime(value, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+            m_if_modified_since = date_end && *date_end == '\0' ? timegm(&tm) : -1;
+            break;
+        }
+        default:
+            break;
     }
     return NO_REQUEST;
 }
 
+/**
+ * @brief 按编号取常用头部的值，不分配内存，值直接指向读缓冲区，在下一个请求开始前有效
+ * @param id HEADER_ID
+ * @param len 不为NULL时返回值的长度
+ * @return 头部的值，以'\0'结尾，没有该头部时返回NULL
+ */
+const char *http_conn::get_header(int id, int *len) const {
+    if (!(m_header_mask & (1u << id)))
+        return NULL;
+    const header_field &field = m_headers[m_header_idx[id]];
+    if (len)
+        *len = field.value_len;
+    return m_read_buf + field.value;
+}
+
+/**
+ * @brief 按名称查找当前请求的头部，名称不区分大小写，常用头部直接按编号取
+ * @param name
+ * @param len 不为NULL时返回值的长度
+ * @return 头部的值，以'\0'结尾，没有该头部时返回NULL
+ */
+const char *http_conn::get_header(const char *name, int *len) const {
+    int name_len = strlen(name);
+    int id = http_header::lookup(name, name_len);
+    if (id != HEADER_UNKNOWN)
+        return get_header(id, len);
+    for (int i = 0; i < m_header_count; ++i) {
+        const header_field &field = m_headers[i];
+        if (field.id == HEADER_UNKNOWN && field.name_len == name_len &&
+            strncasecmp(m_read_buf + field.name, name, name_len) == 0) {
+            if (len)
+                *len = field.value_len;
+            return m_read_buf + field.value;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 解析Accept-Encoding头部，记录客户端接受的gzip、deflate编码，q=0表示明确拒绝
+ * @param text 例如"gzip, deflate;q=0.5, br"
+ */
+void http_conn::parse_accept_encoding(char *text) {
+    while (*text) {
+        text += strspn(text, " \t,");
+        int len = strcspn(text, " \t,;");
+        char *next = text + strcspn(text, ",");
+        //q值为0的编码不接受
+        char *q = strchr(text, ';');
+        bool refused = false;
+        if (q && q < next) {
+            q += 1 + strspn(q + 1, " \t");
+            refused = strncasecmp(q, "q=", 2) == 0 && atof(q + 2) == 0;
+        }
+        if (!refused) {
+            if (len == 4 && strncasecmp(text, "gzip", 4) == 0)
+                m_accept_encoding |= 1 << ENCODING_GZIP;
+            else if (len == 7 && strncasecmp(text, "deflate", 7) == 0)
+                m_accept_encoding |= 1 << ENCODING_DEFLATE;
+        }
+        text = next;
+    }
+}
+
+/**
+ * @brief 解析Connection头部，close优先于keep-alive，其它选项忽略
+ * @param text 例如"keep-alive, Upgrade"
+ */
+void http_conn::parse_connection(const char *text) {
+    while (*text) {
+        text += strspn(text, " \t,");
+        int len = strcspn(text, " \t,");
+        if (len == 5 && strncasecmp(text, "close", 5) == 0) {
+            m_linger = false;
+            return;
+        }
+        if (len == 10 && strncasecmp(text, "keep-alive", 10) == 0)
+            m_linger = true;
+        text += len;
+    }
+}
+
 /**
  * @brief 判断http请求是否被完整读入
  * @param text
@@ -343,6 +649,9 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text) {
  */
 http_conn::HTTP_CODE http_conn::parse_content(char *text) {
     if (m_read_idx >= (m_content_length + m_checked_idx)) {
+        //请求体之后可能紧跟着下一个流水线请求，先保存被截断的字节，并把m_checked_idx移到本请求末尾
+        m_checked_idx += m_content_length;
+        m_body_next = m_read_buf[m_checked_idx];
         text[m_content_length] = '\0';
         //POST请求中最后为输入的用户名和密码
         m_string = text;
@@ -365,16 +674,17 @@ http_conn::HTTP_CODE http_conn::process_read() {
            ((line_status = parse_line()) == LINE_OK)) {
         text = get_line();
         m_start_line = m_checked_idx;
-        LOG_INFO("%s", text);
         switch (m_check_state) {
             case CHECK_STATE_REQUESTLINE: {
-                ret = parse_request_line(text);
+                //只记录请求行，头部不再逐行写日志
+                LOG_INFO("%s", text);
+                ret = parse_request_line(text, m_read_buf + m_checked_idx - 2);
                 if (ret == BAD_REQUEST)
                     return BAD_REQUEST;
                 break;
             }
             case CHECK_STATE_HEADER: {
-                ret = parse_headers(text);
+                ret = parse_headers(text, m_read_buf + m_checked_idx - 2);
                 if (ret == BAD_REQUEST)
                     return BAD_REQUEST;
                 else if (ret == GET_REQUEST) {
@@ -396,110 +706,188 @@ http_conn::HTTP_CODE http_conn::process_read() {
     return NO_REQUEST;
 }
 
+/**
+ * @brief 按下一个要处理的请求选择线程池的调度类别，提交给线程池之前调用
+ * 请求行已经解析时直接查路由，否则只在读缓冲区中找出方法和路径，不修改缓冲区
+ * @return SCHED_CLASS，请求行还不完整或者没有路由时为SCHED_STATIC
+ */
+int http_conn::classify() const {
+    //留到下一批的请求已经执行过do_request，只剩生成响应
+    if (m_deferred != NO_REQUEST)
+        return SCHED_STATIC;
+    const route *r = NULL;
+    if (m_check_state != CHECK_STATE_REQUESTLINE) {
+        r = router::get_instance()->match(m_url, m_method);
+    } else {
+        const char *p = m_read_buf + m_start_line;
+        const char *line = http_scanner::find(p, m_read_buf + m_read_idx, '\r', '\n');
+        const char *sep = http_scanner::find(p, line, ' ', '\t');
+        METHOD method;
+        if (sep - p == 3 && strncasecmp(p, "GET", 3) == 0)
+            method = GET;
+        else if (sep - p == 4 && strncasecmp(p, "POST", 4) == 0)
+            method = POST;
+        else
+            return SCHED_STATIC;
+        const char *url = sep;
+        while (url < line && (*url == ' ' || *url == '\t'))
+            ++url;
+        const char *url_end = http_scanner::find(url, line, ' ', '\t');
+        //和parse_request_line一样去掉绝对URL的协议和主机
+        if (url_end - url > 7 && strncasecmp(url, "http://", 7) == 0)
+            url = http_scanner::find(url + 7, url_end, '/', '/');
+        else if (url_end - url > 8 && strncasecmp(url, "https://", 8) == 0)
+            url = http_scanner::find(url + 8, url_end, '/', '/');
+        char path[256];
+        if (url_end == line || url_end - url >= (long) sizeof(path))
+            return SCHED_STATIC;
+        memcpy(path, url, url_end - url);
+        path[url_end - url] = '\0';
+        r = router::get_instance()->match(path, method);
+    }
+    return r ? r->sched_class : SCHED_STATIC;
+}
+
 /**
  * @brief 基于HTTP协议的服务器中的处理请求的函数(主要的HTML业务逻辑处理函数)
+ * 按路由表分发，没有路由的请求把URL当作文档根目录下的文件
  * @return
  */
 http_conn::HTTP_CODE http_conn::do_request() {
-    //将文档根目录doc_root赋值给m_real_file
-    strcpy(m_real_file, doc_root);
-    int len = strlen(doc_root);
-    //printf("m_url:%s\n", m_url);
-    //找到请求的URL中的最后一个斜杠/位置的指针
-    const char *p = strrchr(m_url, '/');
-
-    //处理cgi
-    if (cgi == 1 && (*(p + 1) == '2' || *(p + 1) == '3')) {
-
-        //根据标志判断是登录检测还是注册检测
-        char flag = m_url[1];
-
-        char *m_url_real = (char *) malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/");
-        strcat(m_url_real, m_url + 2);
-        strncpy(m_real_file + len, m_url_real, FILENAME_LEN - len - 1);
-        free(m_url_real);
-
-        //将用户名和密码提取出来
-        //user=123&passwd=123
-        char name[100], password[100];
-        int i;
-        for (i = 5; m_string[i] != '&'; ++i)
-            name[i - 5] = m_string[i];
-        name[i - 5] = '\0';
-
-        int j = 0;
-        for (i = i + 10; m_string[i] != '\0'; ++i, ++j)
-            password[j] = m_string[i];
-        password[j] = '\0';
-
-        if (*(p + 1) == '3') {
-            //如果是注册，先检测数据库中是否有重名的
-            //没有重名的，进行增加数据
-            char *sql_insert = (char *) malloc(sizeof(char) * 200);
-            strcpy(sql_insert, "INSERT INTO user(username, passwd) VALUES(");
-            strcat(sql_insert, "'");
-            strcat(sql_insert, name);
-            strcat(sql_insert, "', '");
-            strcat(sql_insert, password);
-            strcat(sql_insert, "')");
-
-            if (users.find(name) == users.end()) {
-                m_lock.lock();
-                int res = mysql_query(mysql, sql_insert);
-                users.insert(pair<string, string>(name, password));
-                m_lock.unlock();
-
-                if (!res)
-                    strcpy(m_url, "/log.html");
-                else
-                    strcpy(m_url, "/registerError.html");
-            } else
-                strcpy(m_url, "/registerError.html");
-        }
-            //如果是登录，直接判断
-            //若浏览器端输入的用户名和密码在表中可以查找到，返回1，否则返回0
-        else if (*(p + 1) == '2') {
-            if (users.find(name) != users.end() && users[name] == password)
-                strcpy(m_url, "/welcome.html");
-            else
-                strcpy(m_url, "/logError.html");
-        }
+    const route *r = router::get_instance()->match(m_url, m_method);
+    if (!r) {
+        //路由只比较路径，静态文件也去掉查询串
+        char *query = strchr(m_url, '?');
+        if (query)
+            *query = '\0';
+        return serve_file(m_url);
     }
 
-    if (*(p + 1) == '0') {
-        char *m_url_real = (char *) malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/register.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+    switch (r->type) {
+        case ROUTE_FILE:
+            return serve_file(r->file.c_str());
+        case ROUTE_LOGIN:
+            return do_login();
+        case ROUTE_REGISTER:
+            return do_register();
+        case ROUTE_CALLBACK:
+            return r->handler(this);
+        default:
+            return INTERNAL_ERROR;
+    }
+}
 
-        free(m_url_real);
-    } else if (*(p + 1) == '1') {
-        char *m_url_real = (char *) malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/log.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+/**
+ * @brief 从表单请求体中取出一个字段，超出缓冲区的部分截断
+ * @param body 形如user=123&password=123
+ * @param key 字段名，含等号
+ * @param buf
+ * @param size
+ */
+static void form_value(const char *body, const char *key, char *buf, int size) {
+    int key_len = strlen(key);
+    const char *p = body;
+    while (*p && strncmp(p, key, key_len) != 0) {
+        p = strchr(p, '&');
+        if (!p) {
+            buf[0] = '\0';
+            return;
+        }
+        ++p;
+    }
+    int n = 0;
+    if (*p) {
+        for (p += key_len; *p && *p != '&' && n < size - 1; ++p)
+            buf[n++] = *p;
+    }
+    buf[n] = '\0';
+}
 
-        free(m_url_real);
-    } else if (*(p + 1) == '5') {
-        char *m_url_real = (char *) malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/picture.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+/**
+ * @brief 登录：若浏览器端输入的用户名和密码在表中可以查找到，返回欢迎页，否则返回登录失败页
+ * @return
+ */
+http_conn::HTTP_CODE http_conn::do_login() {
+    char name[100], password[100];
+    form_value(get_body(), "user=", name, sizeof(name));
+    form_value(get_body(), "password=", password, sizeof(password));
+
+    m_lock.lock();
+    map<string, string>::iterator it = users.find(name);
+    bool ok = it != users.end() && it->second == password;
+    m_lock.unlock();
+    return serve_file(ok ? "/welcome.html" : "/logError.html");
+}
 
-        free(m_url_real);
-    } else if (*(p + 1) == '6') {
-        char *m_url_real = (char *) malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/video.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+/**
+ * @brief 注册：先检测数据库中是否有重名的，没有重名的，进行增加数据
+ * 数据库连接只在这里按需获取，插入完成后立即归还，其它请求不占用连接
+ * @return
+ */
+http_conn::HTTP_CODE http_conn::do_register() {
+    char name[100], password[100];
+    form_value(get_body(), "user=", name, sizeof(name));
+    form_value(get_body(), "password=", password, sizeof(password));
+
+    char sql_insert[256];
+    snprintf(sql_insert, sizeof(sql_insert), "INSERT INTO user(username, passwd) VALUES('%s', '%s')", name,
+             password);
+
+    const char *page = "/registerError.html";
+    {
+        //先取连接再加锁，等待空闲连接时不阻塞登录
+        MYSQL *mysql = NULL;
+        connectionRAII mysqlcon(&mysql, connection_pool::GetInstance());
+        m_lock.lock();
+        if (mysql && users.find(name) == users.end()) {
+            int res = mysql_query(mysql, sql_insert);
+            users.insert(pair<string, string>(name, password));
+            if (!res)
+                page = "/log.html";
+        }
+        m_lock.unlock();
+    }
+    return serve_file(page);
+}
 
-        free(m_url_real);
-    } else if (*(p + 1) == '7') {
-        char *m_url_real = (char *) malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/fans.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+/**
+ * @brief 返回文档根目录下的文件，路由的处理函数用它选择响应的文件
+ * @param path 以/开头，相对文档根目录
+ * @return
+ */
+http_conn::HTTP_CODE http_conn::serve_file(const char *path) {
+    //将文档根目录doc_root赋值给m_real_file
+    //请求路径先规范化，..在文档根目录处停止，不能访问根目录之外的文件，同一文件的不同写法对应同一个缓存项
+    std::string url = file_cache::normalize(path);
+    int len = strlen(doc_root);
+    strcpy(m_real_file, doc_root);
+    strncpy(m_real_file + len, url.c_str(), FILENAME_LEN - len - 1);
+    m_real_file[FILENAME_LEN - 1] = '\0';
+
+    //条件请求先比较校验器，命中缓存时用缓存项的stat，否则只stat不打开文件，未修改时直接返回304
+    if (m_method == GET && (get_header(HEADER_IF_NONE_MATCH) || m_if_modified_since >= 0)) {
+        m_file = file_cache::get_instance()->lookup(m_real_file);
+        if (m_file)
+            m_file_stat = m_file->st;
+        if ((m_file || (stat(m_real_file, &m_file_stat) == 0 && S_ISREG(m_file_stat.st_mode) &&
+                        (m_file_stat.st_mode & S_IROTH))) && not_modified()) {
+            if (m_file) {
+                file_cache::get_instance()->release(m_file);
+                m_file = NULL;
+            }
+            return NOT_MODIFIED;
+        }
+    }
 
-        free(m_url_real);
-    } else
-        strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
+    //从文件缓存借用文件，命中时不再stat、open、mmap，小文件是共享的映射，大文件是共享的描述符
+    if (!m_file)
+        m_file = file_cache::get_instance()->acquire(m_real_file);
+    if (m_file) {
+        m_file_stat = m_file->st;
+        return FILE_REQUEST;
+    }
 
+    //文件缓存只接受其它用户可读的普通文件，其余情况在这里区分
     if (stat(m_real_file, &m_file_stat) < 0)
         return NO_RESOURCE;
 
@@ -509,21 +897,187 @@ http_conn::HTTP_CODE http_conn::do_request() {
     if (S_ISDIR(m_file_stat.st_mode))
         return BAD_REQUEST;
 
-    int fd = open(m_real_file, O_RDONLY);
-    m_file_address = (char *) mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
-    return FILE_REQUEST;
+    return INTERNAL_ERROR;
 }
 
 /**
- * @brief 对内存映射区执行munmap操作
- * 取消内存映射
+ * @brief 解析Range头部，只支持bytes单位，结尾超出文件的范围截到文件末尾
+ * @param size 文件大小
+ * @param first 输出各范围的起始位置
+ * @param last 输出各范围的结束位置，包含该字节
+ * @return 可满足的范围数，0表示都不可满足；语法错误或范围过多时返回-1，按规范忽略Range
  */
-void http_conn::unmap() {
-    if (m_file_address) {
-        munmap(m_file_address, m_file_stat.st_size);
-        m_file_address = 0;
+int http_conn::parse_range(off_t size, off_t *first, off_t *last) {
+    const char *range = get_header(HEADER_RANGE);
+    if (strncasecmp(range, "bytes=", 6) != 0)
+        return -1;
+    char *p = (char *) range + 6;
+    int count = 0;
+    while (true) {
+        p += strspn(p, " \t");
+        off_t from, to;
+        if (*p == '-') {
+            //后缀范围，表示最后n个字节
+            if (!isdigit(p[1]))
+                return -1;
+            long long n = strtoll(p + 1, &p, 10);
+            from = n >= size ? 0 : size - n;
+            to = n > 0 ? size - 1 : -1;
+        } else {
+            if (!isdigit(*p))
+                return -1;
+            from = strtoll(p, &p, 10);
+            if (*p++ != '-')
+                return -1;
+            to = size - 1;
+            if (isdigit(*p)) {
+                long long n = strtoll(p, &p, 10);
+                if (n < from)
+                    return -1;
+                if (n < to)
+                    to = n;
+            }
+        }
+        //起始位置超出文件的范围不可满足，跳过
+        if (from < size && from <= to) {
+            if (count == MAX_RANGES)
+                return -1;
+            first[count] = from;
+            last[count] = to;
+            ++count;
+        }
+        p += strspn(p, " \t");
+        if (*p == '\0')
+            break;
+        if (*p++ != ',')
+            return -1;
+    }
+    return count;
+}
+
+/**
+ * @brief If-Range的校验器是否和当前文件一致
+ * If-Range只能用强校验器，ETag要完全相同，日期要和Last-Modified完全相同
+ * @param file
+ * @return
+ */
+bool http_conn::if_range_match(const file_entry *file) {
+    const char *if_range = get_header(HEADER_IF_RANGE);
+    if (if_range[0] == '"') {
+        size_t len = strlen(file->etag);
+        return strncmp(if_range + 1, file->etag, len) == 0 && if_range[len + 1] == '"' && if_range[len + 2] == '\0';
     }
+    return strcmp(if_range, file->last_modified) == 0;
+}
+
+/**
+ * @brief 把文件的[from, to)加入待发送数据，映射的文件直接指向映射地址，否则作为sendfile段
+ * @param file
+ * @param from
+ * @param to
+ */
+void http_conn::add_body(file_entry *file, off_t from, off_t to) {
+    if (file->fd >= 0) {
+        m_send_fd = file->fd;
+        add_segment(from, to);
+    } else {
+        add_iov(file->addr + from, to - from);
+    }
+}
+
+/**
+ * @brief 按Range生成206响应，单个范围直接带Content-Range，多个范围用multipart/byteranges
+ * 范围都不可满足时生成416响应
+ * @param file
+ * @param start 本响应在写缓冲区中的起始位置
+ * @return 1表示已生成响应；0表示应忽略Range发送整个文件，包括写缓冲区放不下多范围的各部分头部；-1表示失败
+ */
+int http_conn::add_partial(file_entry *file, int start) {
+    //客户端手里的版本已经过期时发送整个文件
+    if (get_header(HEADER_IF_RANGE) && !if_range_match(file))
+        return 0;
+    long long size = m_file_stat.st_size;
+    off_t first[MAX_RANGES], last[MAX_RANGES];
+    int count = parse_range(size, first, last);
+    if (count < 0)
+        return 0;
+
+    if (count == 0) {
+        if (!add_status_line(416, error_416_title) || !add_content_range(-1, -1, size) || !add_content_length(0) ||
+            !add_linger() || !add_blank_line())
+            return -1;
+        add_iov(m_write_buf + start, m_write_idx - start);
+        return 1;
+    }
+
+    if (count == 1) {
+        if (!add_status_line(206, partial_206_title) || !add_content_length(last[0] - first[0] + 1) ||
+            !append("Content-Type:") || !append(file->type) || !append("\r\n") ||
+            !add_content_range(first[0], last[0], size) || !add_validators(file->etag, file->last_modified) ||
+            !add_linger() || !add_blank_line()) {
+            m_write_idx = start;
+            return 0;
+        }
+        add_iov(m_write_buf + start, m_write_idx - start);
+        add_body(file, first[0], last[0] + 1);
+        return 1;
+    }
+
+    //先生成各部分的头部和结尾的分隔符，算出消息体长度后再生成响应头，各段按顺序组成iovec，和在缓冲区中的位置无关
+    int part[MAX_RANGES + 1];
+    long long length = 0;
+    bool ok = true;
+    for (int i = 0; i < count && ok; ++i) {
+        part[i] = m_write_idx;
+        ok = append("\r\n--") && append(file->etag) && append("\r\nContent-Type:") && append(file->type) &&
+             append("\r\n") && add_content_range(first[i], last[i], size) && add_blank_line();
+        length += last[i] - first[i] + 1;
+    }
+    part[count] = m_write_idx;
+    ok = ok && append("\r\n--") && append(file->etag) && append("--\r\n");
+    int head = m_write_idx;
+    length += head - start;
+    ok = ok && add_status_line(206, partial_206_title) && add_content_length(length) &&
+         append("Content-Type:multipart/byteranges; boundary=") && append(file->etag) && append("\r\n") &&
+         add_validators(file->etag, file->last_modified) && add_linger() && add_blank_line();
+    if (!ok) {
+        m_write_idx = start;
+        return 0;
+    }
+    add_iov(m_write_buf + head, m_write_idx - head);
+    for (int i = 0; i < count; ++i) {
+        add_iov(m_write_buf + part[i], part[i + 1] - part[i]);
+        add_body(file, first[i], last[i] + 1);
+    }
+    add_iov(m_write_buf + part[count], head - part[count]);
+    return 1;
+}
+
+/**
+ * @brief 按m_file_stat判断条件请求的文件是否未修改
+ * 有If-None-Match时只比较ETag，忽略If-Modified-Since
+ * @return
+ */
+bool http_conn::not_modified() {
+    const char *if_none_match = get_header(HEADER_IF_NONE_MATCH);
+    if (if_none_match) {
+        char etag[48];
+        file_cache::format_etag(etag, sizeof(etag), m_file_stat);
+        return file_cache::etag_match(if_none_match, etag, m_accept_encoding, &m_etag_encoding);
+    }
+    return m_file_stat.st_mtime <= m_if_modified_since;
+}
+
+/**
+ * @brief 把借用的文件还给文件缓存
+ * 映射和描述符由文件缓存统一释放
+ */
+void http_conn::unmap() {
+    file_cache *cache = file_cache::get_instance();
+    for (int i = 0; i < m_file_count; ++i)
+        cache->release(m_files[i]);
+    m_file_count = 0;
+    m_send_fd = -1;
 }
 
 /**
@@ -534,18 +1088,39 @@ bool http_conn::write() {
     int temp = 0;
     //1.判断是否已经发送完所有数据
     if (bytes_to_send == 0) {
-        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
-        //是则调用init()函数重新初始化对象并修改文件描述符的状态为EPOLLIN，然后返回true
-        init();
+        m_backend->modfd(m_sockfd, this, EPOLLIN, m_TRIGMode);
+        //是则重置写状态并修改文件描述符的状态为EPOLLIN，然后返回true
+        reset_write();
         return true;
     }
 
     while (1) {
-        temp = writev(m_sockfd, m_iv, m_iv_count);
+        //下一段sendfile之前的iovec都发完时发送这一段
+        bool segment = m_seg_idx < m_seg_count && m_iv_idx == m_segs[m_seg_idx].iv_end;
+        if (m_linked) {
+            //异步发送没有发完，先按它的结果推进，剩下的部分同步发送
+            m_linked = false;
+            segment = false;
+            temp = m_backend->linked_result(m_sockfd);
+        } else if (!segment) {
+            //各个流水线请求的响应按顺序一次writev发出，后面还有sendfile时带上MSG_MORE，让响应头和文件开头合并成满的报文段
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = m_iv + m_iv_idx;
+            msg.msg_iovlen = (m_seg_idx < m_seg_count ? m_segs[m_seg_idx].iv_end : m_iv_count) - m_iv_idx;
+            temp = sendmsg(m_sockfd, &msg, m_seg_idx < m_seg_count ? MSG_MORE : 0);
+        } else {
+            //sendfile从段的offset继续发送，EAGAIN后下一次可写事件接着发
+            send_segment &seg = m_segs[m_seg_idx];
+            temp = sendfile(m_sockfd, m_send_fd, &seg.offset, seg.end - seg.offset);
+            //文件在发送途中被截断，后面的数据已经无法补齐
+            if (temp == 0)
+                temp = -1;
+        }
 
         if (temp < 0) {
             if (errno == EAGAIN) {
-                modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+                m_backend->modfd(m_sockfd, this, EPOLLOUT, m_TRIGMode);
                 return true;
             }
             unmap();
@@ -554,24 +1129,35 @@ bool http_conn::write() {
 
         bytes_have_send += temp;
         bytes_to_send -= temp;
-        if (bytes_have_send >= m_iv[0].iov_len) {
-            m_iv[0].iov_len = 0;
-            m_iv[1].iov_base = m_file_address + (bytes_have_send - m_write_idx);
-            m_iv[1].iov_len = bytes_to_send;
-        } else {
-            m_iv[0].iov_base = m_write_buf + bytes_have_send;
-            m_iv[0].iov_len = m_iv[0].iov_len - bytes_have_send;
+        //sendfile已经自己推进了偏移
+        if (segment) {
+            if (m_segs[m_seg_idx].offset >= m_segs[m_seg_idx].end)
+                ++m_seg_idx;
+            temp = 0;
+        }
+        //跳过已经发送完的iovec，调整只发送了一部分的iovec
+        while (temp > 0 && m_iv_idx < m_iv_count) {
+            if ((size_t) temp >= m_iv[m_iv_idx].iov_len) {
+                temp -= m_iv[m_iv_idx].iov_len;
+                ++m_iv_idx;
+            } else {
+                m_iv[m_iv_idx].iov_base = (char *) m_iv[m_iv_idx].iov_base + temp;
+                m_iv[m_iv_idx].iov_len -= temp;
+                temp = 0;
+            }
         }
 
         //判断是否已经发送完所有数据
         if (bytes_to_send <= 0) {
             //是则调用unmap()函数关闭文件映射
             unmap();
-            modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
 
-            //根据m_linger判断是否需要保持连接
-            if (m_linger) {
-                init();
+            //根据最后一个响应判断是否需要保持连接，要关闭的连接不再注册EPOLLIN，避免和关闭流程竞争
+            if (m_keep_alive) {
+                reset_write();
+                //读缓冲区中还有完整请求时由调用者接着调用process()，这些数据已经不在内核中，不会再触发读事件
+                if (!m_pipelined)
+                    m_backend->modfd(m_sockfd, this, EPOLLIN, m_TRIGMode);
                 return true;
             } else {
                 return false;
@@ -581,39 +1167,50 @@ bool http_conn::write() {
 }
 
 /**
- * @brief HTTP连接类中添加响应内容的函数
- * @param format
- * @param ...
- * @return
+ * @brief 向写缓冲区追加一段数据，响应头都由常量片段和数字拼接而成，不再格式化
+ * @param data
+ * @param len
+ * @return 写缓冲区放不下时返回false，和原来一样保留最后一个字节
  */
-bool http_conn::add_response(const char *format, ...) {
-    //首先判断写缓冲区是否已满
-    if (m_write_idx >= WRITE_BUFFER_SIZE)
+bool http_conn::append(const char *data, int len) {
+    if (len >= WRITE_BUFFER_SIZE - m_write_idx)
         return false;
-    va_list arg_list;
-    va_start(arg_list, format);
-    //vsnprintf函数将可变参数列表格式化成字符串
-    int len = vsnprintf(m_write_buf + m_write_idx, WRITE_BUFFER_SIZE - 1 - m_write_idx, format, arg_list);
-    if (len >= (WRITE_BUFFER_SIZE - 1 - m_write_idx)) {
-        va_end(arg_list);
-        return false;
-    }
+    memcpy(m_write_buf + m_write_idx, data, len);
     m_write_idx += len;
-    va_end(arg_list);
-
-    LOG_INFO("request:%s", m_write_buf);
-
     return true;
 }
 
 /**
- * @brief 将HTTP响应状态行添加到写缓冲区中
+ * @brief 以十进制追加一个整数，从低位向前生成数字
+ * @param n
+ * @return
+ */
+bool http_conn::append_number(long long n) {
+    char buf[24];
+    char *p = buf + sizeof(buf);
+    unsigned long long u = n < 0 ? 0 - (unsigned long long) n : n;
+    do {
+        *--p = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    if (n < 0)
+        *--p = '-';
+    return append(p, buf + sizeof(buf) - p);
+}
+
+/**
+ * @brief 将HTTP响应状态行添加到写缓冲区中，后面紧跟缓存的Date头部
  * @param status 状态码
  * @param title 状态码对应的原因短语
  * @return
  */
 bool http_conn::add_status_line(int status, const char *title) {
-    return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+    if (!append("HTTP/1.1 ") || !append_number(status) || !append(" ") || !append(title) || !append("\r\n"))
+        return false;
+    if (date_cache::LINE_LEN >= WRITE_BUFFER_SIZE - m_write_idx)
+        return false;
+    m_write_idx += date_cache::get_instance()->copy(m_write_buf + m_write_idx);
+    return true;
 }
 
 /**
@@ -632,8 +1229,8 @@ bool http_conn::add_headers(int content_len) {
  * @param content_len 响应正文的长度
  * @return
  */
-bool http_conn::add_content_length(int content_len) {
-    return add_response("Content-Length:%d\r\n", content_len);
+bool http_conn::add_content_length(long long content_len) {
+    return append("Content-Length:") && append_number(content_len) && append("\r\n");
 }
 
 /**
@@ -641,7 +1238,7 @@ bool http_conn::add_content_length(int content_len) {
  * @return
  */
 bool http_conn::add_content_type() {
-    return add_response("Content-Type:%s\r\n", "text/html");
+    return append("Content-Type:text/html\r\n");
 }
 
 /**
@@ -649,7 +1246,7 @@ bool http_conn::add_content_type() {
  * @return
  */
 bool http_conn::add_linger() {
-    return add_response("Connection:%s\r\n", (m_linger == true) ? "keep-alive" : "close");
+    return m_linger ? append("Connection:keep-alive\r\n") : append("Connection:close\r\n");
 }
 
 /**
@@ -658,7 +1255,7 @@ bool http_conn::add_linger() {
  */
 bool http_conn::add_blank_line() {
     //其中 "\r\n" 表示一个回车符和一个换行符，即 HTTP 报文中的换行符
-    return add_response("%s", "\r\n");
+    return append("\r\n");
 }
 
 /**
@@ -667,7 +1264,57 @@ bool http_conn::add_blank_line() {
  * @return
  */
 bool http_conn::add_content(const char *content) {
-    return add_response("%s", content);
+    return append(content);
+}
+
+/**
+ * @brief 添加Content-Range头部
+ * @param first 范围的起始位置，小于0时表示范围都不可满足，只给出文件大小
+ * @param last 范围的结束位置，包含该字节
+ * @param size 文件大小
+ * @return
+ */
+bool http_conn::add_content_range(long long first, long long last, long long size) {
+    if (!append("Content-Range:bytes "))
+        return false;
+    if (first < 0) {
+        if (!append("*"))
+            return false;
+    } else if (!append_number(first) || !append("-") || !append_number(last)) {
+        return false;
+    }
+    return append("/") && append_number(size) && append("\r\n");
+}
+
+/**
+ * @brief 添加ETag和Last-Modified头部
+ * @param etag 不含引号的ETag
+ * @param last_modified HTTP日期
+ * @return
+ */
+bool http_conn::add_validators(const char *etag, const char *last_modified) {
+    return append("ETag:\"") && append(etag) && append("\"\r\nLast-Modified:") && append(last_modified) &&
+           append("\r\n");
+}
+
+/**
+ * @brief 生成错误响应，写缓冲区中只放状态行和Date，其余部分是预先生成的常量
+ * @param status 400、403、404或500
+ * @return
+ */
+bool http_conn::add_error(int status) {
+    const error_response *error = NULL;
+    for (size_t i = 0; i < sizeof(error_responses) / sizeof(error_responses[0]); ++i) {
+        if (error_responses[i].status == status)
+            error = &error_responses[i];
+    }
+    assert(error);
+    int start = m_write_idx;
+    if (!add_status_line(error->status, error->title))
+        return false;
+    add_iov(m_write_buf + start, m_write_idx - start);
+    add_iov((char *) error->tail[m_linger], error->tail_len[m_linger]);
+    return true;
 }
 
 /**
@@ -676,82 +1323,144 @@ bool http_conn::add_content(const char *content) {
  * @return
  */
 bool http_conn::process_write(HTTP_CODE ret) {
+    //流水线请求的响应依次追加在写缓冲区中，start为本响应的起始位置
+    int start = m_write_idx;
+    //请求格式错误时无法确定下一个请求从哪里开始，达到请求数上限时也在本响应后关闭
+    if (ret == BAD_REQUEST || (m_max_requests > 0 && ++m_request_count >= m_max_requests))
+        m_linger = false;
+    //根据本响应判断发送完后是否保持连接
+    m_keep_alive = m_linger;
     //通过switch语句根据不同的HTTP_CODE类型进行响应报文的填充
     switch (ret) {
-        //当ret为INTERNAL_ERROR时
-        case INTERNAL_ERROR: {
-            add_status_line(500, error_500_title);
-            add_headers(strlen(error_500_form));
-            //向缓冲区m_write_buf中添加消息体内容
-            if (!add_content(error_500_form))
-                return false;
-            break;
-        }
-        case BAD_REQUEST: {
-            add_status_line(404, error_404_title);
-            add_headers(strlen(error_404_form));
-            //向缓冲区m_write_buf中添加消息体内容
-            if (!add_content(error_404_form))
-                return false;
-            break;
-        }
-        case FORBIDDEN_REQUEST: {
-            add_status_line(403, error_403_title);
-            add_headers(strlen(error_403_form));
-            //向缓冲区m_write_buf中添加消息体内容
-            if (!add_content(error_403_form))
+        //错误响应除状态行和Date外都是预先生成的常量
+        case INTERNAL_ERROR:
+            return add_error(500);
+        case BAD_REQUEST:
+            return add_error(400);
+        case FORBIDDEN_REQUEST:
+            return add_error(403);
+        case NO_RESOURCE:
+            return add_error(404);
+        //文件未修改，304只带校验器，没有消息体；客户端缓存的是压缩版本时带压缩版本的ETag，和200响应一致
+        case NOT_MODIFIED: {
+            char etag[64], date[32];
+            int len = file_cache::format_etag(etag, sizeof(etag), m_file_stat);
+            if (m_etag_encoding >= 0)
+                snprintf(etag + len, sizeof(etag) - len, "-%s", ENCODING_GZIP == m_etag_encoding ? "gzip" : "deflate");
+            file_cache::format_http_date(date, sizeof(date), m_file_stat.st_mtime);
+            if (!add_status_line(304, not_modified_304_title) || !add_validators(etag, date) || !add_linger() ||
+                !add_blank_line())
                 return false;
             break;
         }
         //当ret为FILE_REQUEST时
         case FILE_REQUEST: {
-            add_status_line(200, ok_200_title);
+            //借来的文件交给m_files，整批响应发送完毕后再归还，压缩版本随缓存项一起归还
+            file_entry *file = m_file;
+            m_files[m_file_count++] = file;
+            m_file = NULL;
             if (m_file_stat.st_size != 0) {
-                add_headers(m_file_stat.st_size);
-                m_iv[0].iov_base = m_write_buf;
-                m_iv[0].iov_len = m_write_idx;
-                m_iv[1].iov_base = m_file_address;
-                m_iv[1].iov_len = m_file_stat.st_size;
-                m_iv_count = 2;
-                bytes_to_send = m_write_idx + m_file_stat.st_size;
+                //Range只作用于原文件，满足时发送206，不压缩
+                if (m_method == GET && get_header(HEADER_RANGE)) {
+                    int partial = add_partial(file, start);
+                    if (partial != 0)
+                        return partial > 0;
+                }
+                //状态行和Date放在写缓冲区，其余200响应头在文件缓存中预先序列化好，和文件内容组成三个iovec
+                if (!add_status_line(200, ok_200_title))
+                    return false;
+                add_iov(m_write_buf + start, m_write_idx - start);
+                //客户端接受压缩时优先发送缓存的压缩版本
+                file_variant *variant = m_accept_encoding ?
+                                        file_cache::get_instance()->encoded(file, m_accept_encoding) : NULL;
+                if (variant) {
+                    add_iov(variant->header[m_linger], variant->header_len[m_linger]);
+                    add_iov(variant->data, variant->len);
+                    return true;
+                }
+                add_iov(file->header[m_linger], file->header_len[m_linger]);
+                if (file->fd >= 0) {
+                    //sendfile的文件排在这一批的最后，所有iovec发完后再发送
+                    m_send_fd = file->fd;
+                    add_segment(0, m_file_stat.st_size);
+                    return true;
+                }
+                add_iov(file->addr, m_file_stat.st_size);
                 return true;
             } else {
+                add_status_line(200, ok_200_title);
                 const char *ok_string = "<html><body></body></html>";
                 add_headers(strlen(ok_string));
                 if (!add_content(ok_string))
                     return false;
             }
+            break;
         }
         default:
             return false;
     }
-    //m_iv用于存放缓冲区内容
-    m_iv[0].iov_base = m_write_buf;
-    m_iv[0].iov_len = m_write_idx;
-    m_iv_count = 1;
-    //bytes_to_send表示需要发送的字节数
-    bytes_to_send = m_write_idx;
+    //m_iv用于存放缓冲区内容，add_iov同时累加需要发送的字节数bytes_to_send
+    add_iov(m_write_buf + start, m_write_idx - start);
     return true;
 }
 
 /**
  * @brief HTTP连接的处理函数，处理过程分为读取请求和发送响应两个步骤
+ * @return 生成响应失败、需要关闭连接时返回false
  */
-void http_conn::process() {
-    // 处理读事件
-    HTTP_CODE read_ret = process_read();
+bool http_conn::process() {
+    m_pipelined = false;
+    // 处理读事件，上一批留下的已解析请求直接生成响应
+    HTTP_CODE read_ret = m_deferred;
+    m_deferred = NO_REQUEST;
+    if (read_ret == NO_REQUEST)
+        read_ret = process_read();
     // 如果没有请求需要等待下一次读事件
     if (read_ret == NO_REQUEST) {
         // 修改 socket 文件描述符上的事件类型为可读
-        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
-        return;
+        m_backend->modfd(m_sockfd, this, EPOLLIN, m_TRIGMode);
+        return true;
+    }
+    // 处理写事件，读缓冲区中已经有的流水线请求依次生成响应，稍后按顺序一起发送
+    while (true) {
+        bool write_ret = process_write(read_ret);
+        if (!write_ret) {
+            // 写失败则由调用者交给所属事件循环删除定时器并关闭连接，工作线程直接关闭的话定时器会在描述符被复用后误关新连接
+            return false;
+        }
+        // 短连接发送完就关闭，不再处理后面的数据
+        if (!m_linger)
+            break;
+        next_request();
+        if (0 == m_read_idx)
+            break;
+        // 合并的响应达到上限，或者这一批以sendfile的文件结尾时，剩下的请求等这一批发送完毕后再处理
+        if (m_send_fd >= 0 || m_file_count == MAX_PIPELINE || m_iv_count + 3 > 3 * MAX_PIPELINE ||
+            WRITE_BUFFER_SIZE - m_write_idx < RESPONSE_RESERVE) {
+            m_pipelined = true;
+            break;
+        }
+        read_ret = process_read();
+        // 剩余数据不是完整请求，等发送完毕后的读事件
+        if (read_ret == NO_REQUEST)
+            break;
+        // 多范围响应的各部分头部占用写缓冲区较多，已解析的请求留到下一批从空的写缓冲区开始生成
+        const char *range = get_header(HEADER_RANGE);
+        if (range && strchr(range, ',') && m_write_idx > 0) {
+            m_deferred = read_ret;
+            m_pipelined = true;
+            break;
+        }
     }
-    // 处理写事件
-    bool write_ret = process_write(read_ret);
-    if (!write_ret) {
-        // 写失败则关闭连接
-        close_conn();
+    // 保持连接、全部在内存中的响应直接异步发送，并链接下一次读事件，后端不支持时返回false
+    if (m_keep_alive && !m_pipelined && m_send_fd < 0 && m_iv_count > 0) {
+        // 发送可能在返回之前就完成并收到下一个请求，标志要先设置
+        m_linked = true;
+        if (m_backend->send_linked(m_sockfd, m_iv, m_iv_count))
+            return true;
+        m_linked = false;
     }
     // 修改 socket 文件描述符上的事件类型为可写
-    modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+    m_backend->modfd(m_sockfd, this, EPOLLOUT, m_TRIGMode);
+    return true;
 }
@@ -17,22 +17,41 @@
 #include <stdlib.h>
 #include <sys/mman.h>
 #include <stdarg.h>
+#include <ctype.h>
+#include <time.h>
 #include <errno.h>
 #include <sys/wait.h>
 #include <sys/uio.h>
+#include <sys/sendfile.h>
 #include <map>
+#include <atomic>
 
 #include "../lock/locker.h"
 #include "../CGImysql/sql_connection_pool.h"
 #include "../timer/lst_timer.h"
 #include "../log/log.h"
+#include "../reactor/completion_queue.h"
+#include "../reactor/event_backend.h"
+#include "../cache/file_cache.h"
+#include "buffer_pool.h"
+#include "http_scanner.h"
+#include "http_header.h"
+#include "date_cache.h"
 
 //http_conn类
 class http_conn {
 public:     //公有成员
     static const int FILENAME_LEN = 200;        //表示文件名的最大长度
-    static const int READ_BUFFER_SIZE = 2048;   //表示读缓冲区的大小
-    static const int WRITE_BUFFER_SIZE = 1024;  //表示写缓冲区的大小
+    static const int READ_BUFFER_SIZE = 2048;   //表示连接自带读缓冲区的大小，更大的请求从buffer_pool借缓冲区
+    static const int OVERFLOW_SIZE = 64 * 1024; //表示每个线程readv溢出区的大小
+    static const int MAX_PIPELINE = 16;         //流水线请求一次writev最多合并的响应数
+    static const int RESPONSE_RESERVE = 256;    //写缓冲区剩余不足该值时不再合并下一个响应
+    static const int MAX_RANGES = 8;            //一个Range请求最多的范围数，更多时忽略Range发送整个文件
+    //多范围响应每部分的头部最多占用的字节数：分隔符和47字节的ETag、最长24字节的Content-Type、三个19位数字的Content-Range
+    static const int RANGE_PART_SIZE = 192;
+    //表示写缓冲区的大小，响应头和结尾分隔符按512字节计，多范围请求从空的写缓冲区开始生成，MAX_RANGES个部分一定放得下
+    static const int WRITE_BUFFER_SIZE = 512 + MAX_RANGES * RANGE_PART_SIZE;
+    static const int MAX_HEADERS = 64;          //一个请求最多的头部数，更多时按错误请求处理
 
     //定义了HTTP请求的方法，包括GET、POST、HEAD、PUT、DELETE、TRACE、OPTIONS、CONNECT和PATH
     enum METHOD {
@@ -62,6 +81,7 @@ public:     //公有成员
         NO_RESOURCE,
         FORBIDDEN_REQUEST,
         FILE_REQUEST,
+        NOT_MODIFIED,
         INTERNAL_ERROR,
         CLOSED_CONNECTION
     };
@@ -73,17 +93,32 @@ public:     //公有成员
         LINE_OPEN       //行数据尚不完整
     };
 
+    //头部索引中的一项，用相对读缓冲区的偏移表示，扩大读缓冲区后仍然有效
+    struct header_field {
+        int name;       //头部名称的起始位置
+        int name_len;   //头部名称的长度
+        int value;      //去掉首尾空白后的值的起始位置，值以'\0'结尾
+        int value_len;  //值的长度
+        int id;         //常用头部的HEADER_ID，其它为HEADER_UNKNOWN
+    };
+
+    //用sendfile发送的一段文件，前面的iovec发完后再发送
+    struct send_segment {
+        int iv_end;     //该段之前的iovec数量
+        off_t offset;   //下一次sendfile的起始偏移
+        off_t end;      //要发送到的位置
+    };
+
 public:
-    http_conn() {}  //构造函数
+    http_conn() : m_inflight(0), m_generation(0), m_read_buf(m_inline_buf), m_read_size(READ_BUFFER_SIZE) {}  //构造函数
 
     ~http_conn() {} //析构函数
 
 public:     //公有成员
-    void init(int sockfd, const sockaddr_in &addr, char *, int, int, string user, string passwd, string sqlname);
-
-    void close_conn(bool real_close = true);
+    void init(int sockfd, const sockaddr_in &addr, char *, int, int,
+              event_backend *backend, completion_queue *cq, int max_requests);
 
-    void process();
+    bool process();
 
     bool read_once();
 
@@ -95,57 +130,141 @@ public:     //公有成员
 
     void initmysql_result(connection_pool *connPool);
 
-    int timer_flag;
-    int improv;
+    void post_completion(bool close);
+
+    //事件循环提交给线程池之前占用连接，占用期间空闲定时器到期也不能关闭并复用连接
+    void pin() { m_inflight.fetch_add(1, std::memory_order_relaxed); }
+
+    bool defer_close();
+
+    //连接对象每次分配给新连接时加一，用来识别已经关闭的连接投递的过期完成结果
+    unsigned generation() const { return m_generation; }
+
+    //响应发送完毕时读缓冲区中还有未处理的流水线请求，需要再调用一次process()
+    bool pipelined() const { return m_pipelined; }
+
+    int classify() const;
+
+    void release();
 
+    const char *get_header(int id, int *len = NULL) const;
+
+    const char *get_header(const char *name, int *len = NULL) const;
+
+    METHOD get_method() const { return m_method; }
+
+    //请求的目标，含查询串
+    const char *get_url() const { return m_url; }
+
+    //请求体，没有时返回空串
+    const char *get_body(int *len = NULL) const {
+        if (len)
+            *len = m_string ? m_content_length : 0;
+        return m_string ? m_string : "";
+    }
+
+    HTTP_CODE serve_file(const char *path);
 
 private:
     void init();
 
+    void next_request();
+
+    void reset_write();
+
+    void add_iov(char *base, size_t len);
+
+    void add_segment(off_t offset, off_t end);
+
+    int read_some();
+
+    bool grow_read_buf(int size);
+
+    void shrink_read_buf();
+
     HTTP_CODE process_read();
 
     bool process_write(HTTP_CODE ret);
 
-    HTTP_CODE parse_request_line(char *text);
+    HTTP_CODE parse_request_line(char *text, char *end);
 
-    HTTP_CODE parse_headers(char *text);
+    HTTP_CODE parse_headers(char *text, char *end);
 
     HTTP_CODE parse_content(char *text);
 
+    void parse_accept_encoding(char *text);
+
+    void parse_connection(const char *text);
+
     HTTP_CODE do_request();
 
+    HTTP_CODE do_login();
+
+    HTTP_CODE do_register();
+
+    bool not_modified();
+
+    int parse_range(off_t size, off_t *first, off_t *last);
+
+    bool if_range_match(const file_entry *file);
+
+    int add_partial(file_entry *file, int start);
+
+    void add_body(file_entry *file, off_t from, off_t to);
+
     char *get_line() { return m_read_buf + m_start_line; };
 
     LINE_STATUS parse_line();
 
     void unmap();
 
-    bool add_response(const char *format, ...);
+    bool append(const char *data, int len);
+
+    bool append(const char *str) { return append(str, strlen(str)); }
+
+    bool append_number(long long n);
 
     bool add_content(const char *content);
 
     bool add_status_line(int status, const char *title);
 
+    bool add_content_range(long long first, long long last, long long size);
+
+    bool add_validators(const char *etag, const char *last_modified);
+
+    bool add_error(int status);
+
     bool add_headers(int content_length);
 
     bool add_content_type();
 
-    bool add_content_length(int content_length);
+    bool add_content_length(long long content_length);
 
     bool add_linger();
 
     bool add_blank_line();
 
 public:
-    static int m_epollfd;       //表示当前类所对应的 epollfd 文件描述符
-    static int m_user_count;    //表示当前连接的客户数量
-    MYSQL *mysql;               //表示 MySQL 数据库连接句柄
-    int m_state;                //表示当前连接的状态，0 表示读，1 表示写
+    static std::atomic<int> m_user_count;   //表示当前连接的客户数量，多个Reactor线程同时增减
+    int m_state;                //表示当前连接的状态，0 表示读，1 表示写，2 表示已经读取、只需处理
+    http_conn *m_task_next;     //线程池收件箱中的下一个任务
+    long long m_enqueue_us;     //进入线程池请求队列的时刻，用来统计排队时间
+    int m_sched_class;          //提交给线程池时的调度类别，决定进入哪个队列
+    client_data m_client_data;  //定时器使用的连接数据，随连接对象一起从连接池分配
+
+private:
+    static const int CLOSE_PENDING = 1 << 30;  //m_inflight中的标志位，占用期间事件循环要求关闭连接
+    std::atomic<int> m_inflight;    //已经提交给线程池、工作线程还没有处理完的任务数，加上CLOSE_PENDING标志
+    unsigned m_generation;          //连接对象的代数，只由所属事件循环修改
 
 private:    //私有成员
+    event_backend *m_backend;   //表示该连接所属事件循环的I/O后端
+    completion_queue *m_cq; //表示该连接所属事件循环的完成队列
     int m_sockfd;           //表示连接的套接字描述符
     sockaddr_in m_address;  //表示连接的客户端地址
-    char m_read_buf[READ_BUFFER_SIZE];  //表示读缓冲区
+    char *m_read_buf;       //表示读缓冲区，指向m_inline_buf或从buffer_pool借来的块
+    int m_read_size;        //表示读缓冲区的大小
+    char m_inline_buf[READ_BUFFER_SIZE];//表示连接自带的读缓冲区
     int m_read_idx;         //表示当前读缓冲区中数据的末尾位置
     int m_checked_idx;      //表示当前正在分析的字符在读缓冲区中的位置
     int m_start_line;       //表示当前正在分析的行的起始位置
@@ -156,26 +275,41 @@ private:    //私有成员
     char m_real_file[FILENAME_LEN];     //表示请求的文件在服务器上的真实路径
     char *m_url;            //表示请求的 URL
     char *m_version;        //表示 HTTP 版本
-    char *m_host;           //表示请求的主机地址
     int m_content_length;   //表示请求消息体的长度
+    header_field m_headers[MAX_HEADERS];    //表示当前请求已解析的头部，按出现顺序排列
+    int m_header_count;     //表示已解析的头部数量
+    int m_header_idx[HEADER_NUM];       //表示各常用头部在m_headers中的下标，只有m_header_mask中对应位置位时有效
+    unsigned int m_header_mask;         //表示出现过的常用头部，第i位对应HEADER_ID中的第i种
     bool m_linger;          //表示是否保持连接
-    char *m_file_address;   //表示请求的文件在内存中的起始位置
+    int m_accept_encoding;  //表示客户端接受的内容编码，第i位对应CONTENT_ENCODING中的第i种
+    time_t m_if_modified_since;         //表示If-Modified-Since的时间，没有或无法解析时为-1
+    int m_etag_encoding;    //表示If-None-Match匹配的压缩版本的编码，匹配原文件时为-1
+    bool m_keep_alive;      //表示已生成的最后一个响应发送完后是否保持连接
+    int m_max_requests;     //表示本连接最多处理的请求数，0表示不限制
+    int m_request_count;    //表示本连接已生成响应的请求数
+    bool m_pipelined;       //表示因为合并的响应数达到上限，读缓冲区中还留有完整请求
+    HTTP_CODE m_deferred;   //表示已经解析、留到下一批再生成响应的请求，没有时为NO_REQUEST
+    char m_body_next;       //表示请求体之后的第一个字节，解析请求体时被临时改写为'\0'
+    file_entry *m_file;     //表示do_request从文件缓存借来的文件
     struct stat m_file_stat;//表示请求文件的状态
-    struct iovec m_iv[2];   //表示写缓冲区中待发送的数据
-    int m_iv_count;         //表示写缓冲区中待发送的数据数量
-    int cgi;                //是否启用的POST
-    char *m_string;         //存储请求头数据
+    //表示按顺序待发送的各个响应的头部和文件，process()保证开始生成一个响应时至少还有多范围响应需要的空间
+    struct iovec m_iv[3 * MAX_PIPELINE + 2 * MAX_RANGES + 2];
+    int m_iv_count;         //表示待发送的iovec数量
+    int m_iv_idx;           //表示下一个要发送的iovec
+    file_entry *m_files[MAX_PIPELINE];      //表示这一批响应借用、发送完毕后要归还的文件
+    int m_file_count;       //表示借用的文件数量
+    int m_send_fd;          //表示这一批最后一个响应用sendfile发送的文件，描述符属于文件缓存，-1表示没有
+    send_segment m_segs[MAX_RANGES];    //表示m_send_fd要发送的各段，和iovec交替发送
+    int m_seg_count;        //表示段数
+    int m_seg_idx;          //表示下一个要发送的段
+    char *m_string;         //存储请求体数据，没有请求体时为NULL
     int bytes_to_send;      //表示待发送的字节数
     int bytes_have_send;    //表示已发送的字节数
+    bool m_linked;          //表示这一批响应已经交给后端异步发送，发完后后端直接注册读事件
     char *doc_root;         //表示服务器的根目录
 
-    map <string, string> m_users;       //表示用户列表
     int m_TRIGMode;         //表示触发模式
     int m_close_log;        //表示是否关闭日志
-
-    char sql_user[100];     //表示数据库用户名
-    char sql_passwd[100];   //表示数据库密码
-    char sql_name[100];     //表示数据库名
 };
 
 #endif
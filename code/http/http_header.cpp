@@ -0,0 +1,50 @@
+#include "http_header.h"
+
+#include <assert.h>
+
+//顺序和HEADER_ID一致
+const char *const http_header::m_names[HEADER_NUM] = {
+        "Host",
+        "Connection",
+        "Content-Length",
+        "Content-Type",
+        "Accept",
+        "Accept-Encoding",
+        "Accept-Language",
+        "User-Agent",
+        "Cookie",
+        "Referer",
+        "If-None-Match",
+        "If-Modified-Since",
+        "Range",
+        "If-Range",
+        "Cache-Control",
+        "Origin",
+        "Upgrade",
+        "Authorization",
+        "Pragma",
+        "Transfer-Encoding",
+        "Expect",
+        "Keep-Alive",
+        "Upgrade-Insecure-Requests",
+};
+
+int http_header::m_lens[HEADER_NUM];
+signed char http_header::m_slots[SLOT_NUM];
+bool http_header::m_built = http_header::build();
+
+/**
+ * @brief 按名称表填写哈希槽，增加常用头部后哈希冲突时断言失败，需要调整hash
+ * @return
+ */
+bool http_header::build() {
+    for (int i = 0; i < SLOT_NUM; ++i)
+        m_slots[i] = HEADER_UNKNOWN;
+    for (int id = 0; id < HEADER_NUM; ++id) {
+        m_lens[id] = strlen(m_names[id]);
+        int slot = hash(m_names[id], m_lens[id]);
+        assert(m_slots[slot] == HEADER_UNKNOWN);
+        m_slots[slot] = id;
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+#ifndef HTTP_HEADER_H
+#define HTTP_HEADER_H
+
+#include <string.h>
+#include <strings.h>
+
+//常用的请求头部，解析时按名称映射到编号，按编号直接取值
+//最多32种，http_conn用一个32位掩码记录出现过的头部
+enum HEADER_ID {
+    HEADER_UNKNOWN = -1,
+    HEADER_HOST = 0,
+    HEADER_CONNECTION,
+    HEADER_CONTENT_LENGTH,
+    HEADER_CONTENT_TYPE,
+    HEADER_ACCEPT,
+    HEADER_ACCEPT_ENCODING,
+    HEADER_ACCEPT_LANGUAGE,
+    HEADER_USER_AGENT,
+    HEADER_COOKIE,
+    HEADER_REFERER,
+    HEADER_IF_NONE_MATCH,
+    HEADER_IF_MODIFIED_SINCE,
+    HEADER_RANGE,
+    HEADER_IF_RANGE,
+    HEADER_CACHE_CONTROL,
+    HEADER_ORIGIN,
+    HEADER_UPGRADE,
+    HEADER_AUTHORIZATION,
+    HEADER_PRAGMA,
+    HEADER_TRANSFER_ENCODING,
+    HEADER_EXPECT,
+    HEADER_KEEP_ALIVE,
+    HEADER_UPGRADE_INSECURE_REQUESTS,
+    HEADER_NUM
+};
+
+//http_header类，头部名称到编号的完美哈希
+//哈希值由名称长度、首字母和末字母算出，常用头部两两不冲突，查找只需一次哈希和一次名称比较
+class http_header {
+public:     //公有成员
+    //不区分大小写查找名称的编号，不是常用头部时返回HEADER_UNKNOWN
+    static int lookup(const char *name, int len) {
+        if (len <= 0)
+            return HEADER_UNKNOWN;
+        int id = m_slots[hash(name, len)];
+        if (id != HEADER_UNKNOWN && m_lens[id] == len && strncasecmp(m_names[id], name, len) == 0)
+            return id;
+        return HEADER_UNKNOWN;
+    }
+
+    static const char *name(int id) { return m_names[id]; }
+
+private:    //私有成员
+    static const int SLOT_NUM = 64;
+
+    static int hash(const char *name, int len) {
+        //按小写字母计算，非字母的首末字符可能和其它名称冲突，由名称比较排除
+        return (len + (name[0] | 0x20) + 4 * (name[len - 1] | 0x20)) & (SLOT_NUM - 1);
+    }
+
+    static bool build();
+
+private:    //私有成员
+    static const char *const m_names[HEADER_NUM];   //各编号的标准名称
+    static int m_lens[HEADER_NUM];                  //各名称的长度
+    static signed char m_slots[SLOT_NUM];           //哈希槽到编号，空槽为HEADER_UNKNOWN
+    static bool m_built;                            //静态初始化时由build填好上面两张表
+};
+
+#endif
@@ -0,0 +1,122 @@
+#include <string.h>
+#include "http_scanner.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+http_scanner::find_fn http_scanner::m_find = http_scanner::select();
+
+/**
+ * @brief 按CPUID选择查找实现，优先AVX2，其次SSE4.2，都不支持时逐字节查找
+ * 在静态初始化阶段调用，此时CPU特性信息可能还没有初始化，先显式初始化
+ * @return
+ */
+http_scanner::find_fn http_scanner::select() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return find_avx2;
+    if (__builtin_cpu_supports("sse4.2"))
+        return find_sse42;
+#endif
+    return find_scalar;
+}
+
+/**
+ * @brief 选用的实现名称
+ * @return
+ */
+const char *http_scanner::name() {
+#if defined(__x86_64__) || defined(__i386__)
+    if (m_find == find_avx2)
+        return "avx2";
+    if (m_find == find_sse42)
+        return "sse4.2";
+#endif
+    return "scalar";
+}
+
+/**
+ * @brief 按名称指定实现，名称与name()的返回值相同，用于对比各实现的结果和速度
+ * @param impl
+ * @return 名称未知或CPU不支持时返回false，当前实现不变
+ */
+bool http_scanner::use(const char *impl) {
+    find_fn fn = NULL;
+    if (strcmp(impl, "scalar") == 0)
+        fn = find_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+    else if (strcmp(impl, "sse4.2") == 0 && __builtin_cpu_supports("sse4.2"))
+        fn = find_sse42;
+    else if (strcmp(impl, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+        fn = find_avx2;
+#endif
+    if (!fn)
+        return false;
+    m_find = fn;
+    return true;
+}
+
+/**
+ * @brief 逐字节查找，也用于向量实现最后不足一个向量的部分
+ * @param begin
+ * @param end
+ * @param a
+ * @param b
+ * @return
+ */
+const char *http_scanner::find_scalar(const char *begin, const char *end, char a, char b) {
+    for (; begin < end; ++begin) {
+        if (*begin == a || *begin == b)
+            return begin;
+    }
+    return end;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/**
+ * @brief 用pcmpestri一次比较16字节，取第一个等于a或b的位置
+ * @param begin
+ * @param end
+ * @param a
+ * @param b
+ * @return
+ */
+__attribute__((target("sse4.2")))
+const char *http_scanner::find_sse42(const char *begin, const char *end, char a, char b) {
+    const __m128i set = _mm_setr_epi8(a, b, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    //只做完整的16字节加载，不读取end之后的内存
+    for (; end - begin >= 16; begin += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *) begin);
+        int idx = _mm_cmpestri(set, 2, block, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (idx < 16)
+            return begin + idx;
+    }
+    return find_scalar(begin, end, a, b);
+}
+
+/**
+ * @brief 一次比较32字节，两次相等比较合并后由掩码的最低位得到第一个位置
+ * @param begin
+ * @param end
+ * @param a
+ * @param b
+ * @return
+ */
+__attribute__((target("avx2")))
+const char *http_scanner::find_avx2(const char *begin, const char *end, char a, char b) {
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    for (; end - begin >= 32; begin += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *) begin);
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(block, va), _mm256_cmpeq_epi8(block, vb));
+        unsigned mask = (unsigned) _mm256_movemask_epi8(hit);
+        if (mask)
+            return begin + __builtin_ctz(mask);
+    }
+    return find_sse42(begin, end, a, b);
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef HTTP_SCANNER_H
+#define HTTP_SCANNER_H
+
+#include <stddef.h>
+
+//http_scanner类，请求解析用的分隔符查找
+//一次比较16字节(SSE4.2)或32字节(AVX2)，找出行尾、空格、冒号等分隔符的位置，CPU不支持时用逐字节的实现
+//具体实现在第一次使用前按CPUID选定，之后只是一次间接调用
+class http_scanner {
+public:     //公有成员
+    //在[begin, end)中查找第一个等于a或b的字节，没有时返回end，只读取这个区间内的字节
+    static const char *find(const char *begin, const char *end, char a, char b) {
+        return m_find(begin, end, a, b);
+    }
+
+    static const char *name();  //选用的实现名称，用于日志
+
+    static bool use(const char *impl);  //按名称指定实现，用于对比各实现，CPU不支持时返回false
+
+private:    //私有成员
+    typedef const char *(*find_fn)(const char *, const char *, char, char);
+
+    static find_fn select();
+
+    static const char *find_scalar(const char *begin, const char *end, char a, char b);
+
+#if defined(__x86_64__) || defined(__i386__)
+
+    static const char *find_sse42(const char *begin, const char *end, char a, char b);
+
+    static const char *find_avx2(const char *begin, const char *end, char a, char b);
+
+#endif
+
+private:    //私有成员
+    static find_fn m_find;      //select选定的实现
+};
+
+#endif
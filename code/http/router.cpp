@@ -0,0 +1,204 @@
+#include "router.h"
+
+#include <map>
+
+/**
+ * @brief 单例模式，第一次使用时创建
+ * @return
+ */
+router *router::get_instance() {
+    static router instance;
+    return &instance;
+}
+
+router::router() : m_compiled(false) {
+}
+
+router::~router() {
+}
+
+/**
+ * @brief 注册一条路由，同一路径同一种匹配方式重复注册时以后注册的为准
+ * @param path 以/开头的路径，不含查询串
+ * @param prefix 是否为前缀路由
+ * @param type
+ * @param file ROUTE_FILE返回的文件
+ * @param handler ROUTE_CALLBACK的回调函数
+ * @param methods 允许的请求方法
+ * @param sched_class 调度类别
+ */
+void router::add(const char *path, bool prefix, ROUTE_TYPE type, const char *file, route_handler handler,
+                 int methods, int sched_class) {
+    assert(!m_compiled && path && path[0] == '/');
+    entry e;
+    e.path = path;
+    e.prefix = prefix;
+    e.r.type = type;
+    e.r.methods = methods;
+    e.r.file = file ? file : "";
+    e.r.handler = handler;
+    e.r.sched_class = sched_class;
+    m_entries.push_back(e);
+}
+
+/**
+ * @brief 精确匹配path时返回文档根目录下的file
+ * @param path
+ * @param file
+ * @param methods
+ */
+void router::add_file(const char *path, const char *file, int methods) {
+    add(path, false, ROUTE_FILE, file, NULL, methods, SCHED_STATIC);
+}
+
+/**
+ * @brief 精确匹配path时按请求体登录，需要访问数据库
+ * @param path
+ * @param methods
+ */
+void router::add_login(const char *path, int methods) {
+    add(path, false, ROUTE_LOGIN, NULL, NULL, methods, SCHED_DB);
+}
+
+/**
+ * @brief 精确匹配path时按请求体注册，需要访问数据库
+ * @param path
+ * @param methods
+ */
+void router::add_register(const char *path, int methods) {
+    add(path, false, ROUTE_REGISTER, NULL, NULL, methods, SCHED_DB);
+}
+
+/**
+ * @brief 精确匹配path时调用handler
+ * @param path
+ * @param handler
+ * @param methods
+ * @param sched_class 调度类别，访问数据库的回调用SCHED_DB，管理接口用SCHED_ADMIN
+ */
+void router::add_callback(const char *path, route_handler handler, int methods, int sched_class) {
+    assert(handler);
+    add(path, false, ROUTE_CALLBACK, NULL, handler, methods, sched_class);
+}
+
+/**
+ * @brief 路径以prefix开头时返回文档根目录下的file
+ * @param prefix
+ * @param file
+ * @param methods
+ */
+void router::add_file_prefix(const char *prefix, const char *file, int methods) {
+    add(prefix, true, ROUTE_FILE, file, NULL, methods, SCHED_STATIC);
+}
+
+/**
+ * @brief 路径以prefix开头时调用handler
+ * @param prefix
+ * @param handler
+ * @param methods
+ * @param sched_class 调度类别
+ */
+void router::add_callback_prefix(const char *prefix, route_handler handler, int methods, int sched_class) {
+    assert(handler);
+    add(prefix, true, ROUTE_CALLBACK, NULL, handler, methods, sched_class);
+}
+
+/**
+ * @brief 把注册的路由编译成字典树，每个结点的边按字节排序后连续存放
+ * 先用map建树，再按广度优先顺序展开成数组，启动时调用一次
+ */
+void router::compile() {
+    assert(!m_compiled);
+    struct build_node {
+        int exact;
+        int prefix;
+        std::map<unsigned char, int> children;
+    };
+    std::vector<build_node> tree(1);
+    tree[0].exact = tree[0].prefix = -1;
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        const std::string &path = m_entries[i].path;
+        int cur = 0;
+        for (size_t j = 0; j < path.size(); ++j) {
+            unsigned char c = path[j];
+            std::map<unsigned char, int>::iterator it = tree[cur].children.find(c);
+            if (it != tree[cur].children.end()) {
+                cur = it->second;
+            } else {
+                tree.push_back(build_node());
+                int next = tree.size() - 1;
+                tree[next].exact = tree[next].prefix = -1;
+                tree[cur].children[c] = next;
+                cur = next;
+            }
+        }
+        if (m_entries[i].prefix)
+            tree[cur].prefix = i;
+        else
+            tree[cur].exact = i;
+    }
+
+    //广度优先编号，同一结点的子结点编号连续
+    std::vector<int> order(1, 0);
+    std::vector<int> index(tree.size(), 0);
+    for (size_t k = 0; k < order.size(); ++k) {
+        build_node &n = tree[order[k]];
+        for (std::map<unsigned char, int>::iterator it = n.children.begin(); it != n.children.end(); ++it) {
+            index[it->second] = order.size();
+            order.push_back(it->second);
+        }
+    }
+    m_nodes.resize(order.size());
+    for (size_t k = 0; k < order.size(); ++k) {
+        build_node &n = tree[order[k]];
+        node &out = m_nodes[k];
+        out.exact = n.exact;
+        out.prefix = n.prefix;
+        out.first = m_labels.size();
+        out.count = n.children.size();
+        for (std::map<unsigned char, int>::iterator it = n.children.begin(); it != n.children.end(); ++it) {
+            m_labels.push_back(it->first);
+            m_targets.push_back(index[it->second]);
+        }
+    }
+    m_compiled = true;
+}
+
+/**
+ * @brief 查找URL对应的路由，只比较查询串之前的路径
+ * @param url
+ * @param method 请求方法，路由不允许该方法时视为没有路由
+ * @return 没有路由时返回NULL，由调用者按静态文件处理
+ */
+const route *router::match(const char *url, int method) const {
+    if (!m_compiled)
+        return NULL;
+    int cur = 0;
+    int found = m_nodes[0].prefix;
+    const char *p = url;
+    for (; *p && *p != '?'; ++p) {
+        const node &n = m_nodes[cur];
+        unsigned char c = *p;
+        int next = -1;
+        for (int i = n.first; i < n.first + n.count; ++i) {
+            if (m_labels[i] == c) {
+                next = m_targets[i];
+                break;
+            }
+            if (m_labels[i] > c)
+                break;
+        }
+        if (next < 0)
+            break;
+        cur = next;
+        //记下经过的最长前缀路由
+        if (m_nodes[cur].prefix >= 0)
+            found = m_nodes[cur].prefix;
+    }
+    if ((*p == '\0' || *p == '?') && m_nodes[cur].exact >= 0)
+        found = m_nodes[cur].exact;
+    if (found < 0)
+        return NULL;
+    const route &r = m_entries[found].r;
+    return (r.methods & (1 << method)) ? &r : NULL;
+}
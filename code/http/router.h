@@ -0,0 +1,92 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <assert.h>
+#include <string>
+#include <vector>
+
+#include "http_conn.h"
+#include "../threadpool/threadpool.h"
+
+//路由的处理方式
+enum ROUTE_TYPE {
+    ROUTE_FILE = 0,     //返回文档根目录下的指定文件
+    ROUTE_LOGIN,        //校验请求体中的用户名和密码，返回欢迎页或登录失败页
+    ROUTE_REGISTER,     //注册请求体中的用户名和密码，返回登录页或注册失败页
+    ROUTE_CALLBACK      //调用注册的回调函数
+};
+
+//自定义路由的回调，可以用get_url、get_header、get_body读取请求，用serve_file选择要返回的文件
+typedef http_conn::HTTP_CODE (*route_handler)(http_conn *conn);
+
+//一条路由
+struct route {
+    ROUTE_TYPE type;
+    int methods;            //允许的请求方法，第i位对应http_conn::METHOD中的第i种，其它方法按静态文件处理
+    std::string file;       //ROUTE_FILE返回的文件，相对文档根目录，以/开头
+    route_handler handler;  //ROUTE_CALLBACK的回调函数
+    int sched_class;        //线程池的调度类别，SCHED_CLASS
+};
+
+//router类，进程内共享的路由表
+//启动时注册精确路由和前缀路由，compile编译成字节字典树，之后只读，工作线程查找不加锁
+//查找沿URL的路径部分走一遍字典树，时间和路径长度成正比，不分配内存；精确路由优先，其次是最长的前缀路由
+//每条路由带一个调度类别，登录和注册要访问数据库，事件循环提交请求前按它选择线程池的队列
+class router {
+public:     //公有成员
+    static const int METHOD_GET = 1 << http_conn::GET;
+    static const int METHOD_POST = 1 << http_conn::POST;
+    static const int METHOD_ANY = -1;
+
+    static router *get_instance();      //单例模式
+
+    void add_file(const char *path, const char *file, int methods = METHOD_ANY);
+
+    void add_login(const char *path, int methods = METHOD_POST);
+
+    void add_register(const char *path, int methods = METHOD_POST);
+
+    void add_callback(const char *path, route_handler handler, int methods = METHOD_ANY,
+                      int sched_class = SCHED_STATIC);
+
+    void add_file_prefix(const char *prefix, const char *file, int methods = METHOD_ANY);
+
+    void add_callback_prefix(const char *prefix, route_handler handler, int methods = METHOD_ANY,
+                             int sched_class = SCHED_STATIC);
+
+    void compile();
+
+    const route *match(const char *url, int method) const;
+
+private:    //私有成员
+    router();
+
+    ~router();
+
+    void add(const char *path, bool prefix, ROUTE_TYPE type, const char *file, route_handler handler, int methods,
+             int sched_class);
+
+private:    //私有成员
+    //字典树的一个结点，子结点的边在m_labels和m_targets中连续存放，按字节排序
+    struct node {
+        int exact;      //在此结束的精确路由，-1表示没有
+        int prefix;     //在此结束的前缀路由，-1表示没有
+        int first;      //第一条边的下标
+        int count;      //边数
+    };
+
+    //注册时的路由，compile后按下标引用
+    struct entry {
+        std::string path;
+        bool prefix;
+        route r;
+    };
+
+    std::vector<entry> m_entries;           //注册的路由
+    std::vector<node> m_nodes;              //编译后的字典树，下标0为根
+    std::vector<unsigned char> m_labels;    //各条边的字节
+    std::vector<int> m_targets;             //各条边指向的结点
+    bool m_compiled;                        //compile之后不能再注册
+};
+
+#endif
@@ -4,6 +4,10 @@
 #include <exception>
 #include <pthread.h>
 #include <semaphore.h>
+#include <unistd.h>
+#include <atomic>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 //sem类
 class sem {
@@ -181,4 +185,52 @@ private:
     pthread_cond_t m_cond;
 };
 
+//futex类，一个32位计数器，等待者在值没有变化时休眠，唤醒者把值加一再唤醒
+//不带互斥锁，唤醒者没有等待者时调用者可以跳过wake，不进入内核
+class futex {
+public:
+
+    /**
+     * @brief 构造函数
+     */
+    futex() : m_word(0) {
+    }
+
+    /**
+     * @brief 读取当前值，等待前先读取，再检查等待条件
+     * @return
+     */
+    int load() const {
+        return m_word.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief 值仍然等于expected时休眠，期间被wake、值已经变化或者超时时返回
+     * @param expected 检查等待条件之前load得到的值
+     * @param timeout_ms 最长休眠的毫秒数，小于0时一直等待
+     */
+    void wait(int expected, int timeout_ms = -1) {
+        struct timespec ts;
+        struct timespec *timeout = NULL;
+        if (timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+            timeout = &ts;
+        }
+        syscall(SYS_futex, (int *) &m_word, FUTEX_WAIT_PRIVATE, expected, timeout, NULL, 0);
+    }
+
+    /**
+     * @brief 把值加一，唤醒最多n个等待者
+     * @param n
+     */
+    void wake(int n) {
+        m_word.fetch_add(1, std::memory_order_release);
+        syscall(SYS_futex, (int *) &m_word, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+    }
+
+private:
+    std::atomic<int> m_word;
+};
+
 #endif
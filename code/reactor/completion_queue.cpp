@@ -0,0 +1,55 @@
+#include "completion_queue.h"
+
+/**
+ * @brief 构造函数，创建非阻塞的eventfd
+ */
+completion_queue::completion_queue() {
+    m_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_eventfd < 0)
+        throw std::exception();
+}
+
+/**
+ * @brief 析构函数
+ */
+completion_queue::~completion_queue() {
+    close(m_eventfd);
+}
+
+/**
+ * @brief 工作线程调用，投递一个完成结果并唤醒事件循环
+ * 投递之后工作线程不能再访问该连接，事件循环可能已经把它关闭
+ * @param conn
+ * @param generation 投递时连接对象的代数
+ * @param close
+ */
+void completion_queue::push(http_conn *conn, unsigned generation, bool close) {
+    completion c;
+    c.conn = conn;
+    c.generation = generation;
+    c.close = close;
+
+    m_lock.lock();
+    bool was_empty = m_done.empty();
+    m_done.push_back(c);
+    m_lock.unlock();
+
+    //队列从空变为非空时才需要写eventfd，事件循环一次会取走全部结果
+    if (was_empty) {
+        uint64_t one = 1;
+        ::write(m_eventfd, &one, sizeof(one));
+    }
+}
+
+/**
+ * @brief 事件循环调用，读空eventfd并取走当前所有完成结果
+ * @param out
+ */
+void completion_queue::drain(std::vector<completion> &out) {
+    uint64_t count;
+    ::read(m_eventfd, &count, sizeof(count));
+
+    m_lock.lock();
+    out.swap(m_done);
+    m_lock.unlock();
+}
@@ -0,0 +1,38 @@
+#ifndef COMPLETION_QUEUE_H
+#define COMPLETION_QUEUE_H
+
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <vector>
+#include "../lock/locker.h"
+
+class http_conn;
+
+//工作线程处理完一个请求后投递给事件循环的结果
+struct completion {
+    http_conn *conn;    //完成请求的连接
+    unsigned generation;    //投递时连接对象的代数，和当前代数不同说明连接已经被关闭并复用
+    bool close;     //读写失败，需要事件循环删除定时器并关闭连接
+};
+
+//completion_queue类，工作线程投递、事件循环批量取出，通过eventfd唤醒事件循环
+class completion_queue {
+public:     //公有成员
+    completion_queue();
+
+    ~completion_queue();
+
+    int get_fd() { return m_eventfd; }
+
+    void push(http_conn *conn, unsigned generation, bool close);
+
+    void drain(std::vector<completion> &out);
+
+private:    //私有成员
+    int m_eventfd;                  //注册到事件循环epoll上的eventfd
+    locker m_lock;                  //保护完成队列
+    std::vector<completion> m_done; //尚未被事件循环取走的完成结果
+};
+
+#endif
@@ -0,0 +1,138 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <exception>
+#include "event_backend.h"
+
+/**
+ * @brief 构造函数，创建epoll内核事件表
+ */
+epoll_backend::epoll_backend() {
+    m_epollfd = epoll_create(5);    //size 5已经失效
+    if (m_epollfd == -1)
+        throw std::exception();
+}
+
+/**
+ * @brief 析构函数
+ */
+epoll_backend::~epoll_backend() {
+    close(m_epollfd);
+}
+
+/**
+ * @brief 将内核事件表注册读事件，ET模式，选择开启EPOLLONESHOT，并设置非阻塞
+ * @param fd
+ * @param ptr 就绪时通过data.ptr返回
+ * @param one_shot
+ * @param TRIGMode
+ */
+void epoll_backend::addfd(int fd, void *ptr, bool one_shot, int TRIGMode) {
+    epoll_event event;
+    event.data.ptr = ptr;
+
+    if (1 == TRIGMode)
+        event.events = EPOLLIN | EPOLLET | EPOLLRDHUP;
+    else
+        event.events = EPOLLIN | EPOLLRDHUP;
+
+    if (one_shot)
+        event.events |= EPOLLONESHOT;
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, fd, &event);
+
+    int old_option = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, old_option | O_NONBLOCK);
+}
+
+/**
+ * @brief 将事件重置为EPOLLONESHOT
+ * @param fd
+ * @param ptr
+ * @param ev
+ * @param TRIGMode
+ */
+void epoll_backend::modfd(int fd, void *ptr, int ev, int TRIGMode) {
+    epoll_event event;
+    event.data.ptr = ptr;
+
+    if (1 == TRIGMode)
+        event.events = ev | EPOLLET | EPOLLONESHOT | EPOLLRDHUP;
+    else
+        event.events = ev | EPOLLONESHOT | EPOLLRDHUP;
+
+    epoll_ctl(m_epollfd, EPOLL_CTL_MOD, fd, &event);
+}
+
+/**
+ * @brief 从内核时间表删除描述符并关闭
+ * @param fd
+ */
+void epoll_backend::removefd(int fd) {
+    epoll_ctl(m_epollfd, EPOLL_CTL_DEL, fd, 0);
+    close(fd);
+}
+
+/**
+ * @brief 注册监听套接字，不开启EPOLLONESHOT
+ * @param listenfd
+ * @param ptr
+ * @param TRIGMode
+ */
+void epoll_backend::add_listen(int listenfd, void *ptr, int TRIGMode) {
+    addfd(listenfd, ptr, false, TRIGMode);
+}
+
+/**
+ * @brief 直接调用accept获取新连接
+ * @param listenfd
+ * @param client_address
+ * @return
+ */
+int epoll_backend::accept(int listenfd, struct sockaddr_in *client_address) {
+    socklen_t client_addrlength = sizeof(*client_address);
+    return ::accept(listenfd, (struct sockaddr *) client_address, &client_addrlength);
+}
+
+/**
+ * @brief 等待就绪事件
+ * @param events
+ * @param max_events
+ * @param timeout_ms
+ * @return
+ */
+int epoll_backend::wait(epoll_event *events, int max_events, int timeout_ms) {
+    return epoll_wait(m_epollfd, events, max_events, timeout_ms);
+}
+
+/**
+ * @brief 直接从套接字读取
+ * @param fd
+ * @param iov
+ * @param iovcnt
+ * @return
+ */
+ssize_t epoll_backend::readv(int fd, const struct iovec *iov, int iovcnt) {
+    return ::readv(fd, iov, iovcnt);
+}
+
+/**
+ * @brief epoll没有异步发送，由连接注册EPOLLOUT后自己发送
+ * @param fd
+ * @param iov
+ * @param iovcnt
+ * @return
+ */
+bool epoll_backend::send_linked(int, const struct iovec *, int) {
+    return false;
+}
+
+/**
+ * @brief send_linked总是失败，不会有结果
+ * @param fd
+ * @return
+ */
+ssize_t epoll_backend::linked_result(int) {
+    errno = EINVAL;
+    return -1;
+}
@@ -0,0 +1,73 @@
+#ifndef EVENT_BACKEND_H
+#define EVENT_BACKEND_H
+
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+//event_backend类，事件循环使用的I/O多路复用后端，事件统一用epoll_event表示
+//就绪事件的data.ptr是注册时传入的指针，连接为http_conn对象，不再按描述符索引
+class event_backend {
+public:     //公有成员
+    virtual ~event_backend() {}
+
+    //注册描述符的读事件，one_shot为true时触发一次后需要modfd重新注册
+    virtual void addfd(int fd, void *ptr, bool one_shot, int TRIGMode) = 0;
+
+    //重新注册EPOLLONESHOT描述符的事件，可以在工作线程中调用
+    virtual void modfd(int fd, void *ptr, int ev, int TRIGMode) = 0;
+
+    //注销并关闭描述符，可以在工作线程中调用
+    virtual void removefd(int fd) = 0;
+
+    //注册监听套接字
+    virtual void add_listen(int listenfd, void *ptr, int TRIGMode) = 0;
+
+    //取出一个新连接，没有时返回-1并置errno为EAGAIN
+    virtual int accept(int listenfd, struct sockaddr_in *client_address) = 0;
+
+    //等待事件，返回就绪事件数，timeout_ms为-1时一直等待
+    virtual int wait(epoll_event *events, int max_events, int timeout_ms) = 0;
+
+    //读取连接上的数据，语义同readv，后端可能已经在就绪时把数据收到了自己的缓冲区
+    virtual ssize_t readv(int fd, const struct iovec *iov, int iovcnt) = 0;
+
+    //异步发送一批响应，发完后接着注册读事件，代替EPOLLOUT加同步writev再modfd；不支持时返回false
+    //全部发完时不产生事件，没有发完或失败时产生可写或错误事件，由linked_result取得结果
+    //iov数组和它指向的数据在发送完成前必须保持有效
+    virtual bool send_linked(int fd, const struct iovec *iov, int iovcnt) = 0;
+
+    //取出send_linked没有发完时已经发送的字节数，失败时返回-1并设置errno
+    virtual ssize_t linked_result(int fd) = 0;
+};
+
+//epoll_backend类，默认后端
+class epoll_backend : public event_backend {
+public:     //公有成员
+    epoll_backend();
+
+    ~epoll_backend();
+
+    void addfd(int fd, void *ptr, bool one_shot, int TRIGMode);
+
+    void modfd(int fd, void *ptr, int ev, int TRIGMode);
+
+    void removefd(int fd);
+
+    void add_listen(int listenfd, void *ptr, int TRIGMode);
+
+    int accept(int listenfd, struct sockaddr_in *client_address);
+
+    int wait(epoll_event *events, int max_events, int timeout_ms);
+
+    ssize_t readv(int fd, const struct iovec *iov, int iovcnt);
+
+    bool send_linked(int fd, const struct iovec *iov, int iovcnt);
+
+    ssize_t linked_result(int fd);
+
+private:    //私有成员
+    int m_epollfd;      //epoll内核事件表
+};
+
+#endif
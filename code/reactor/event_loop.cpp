@@ -0,0 +1,495 @@
+#include "event_loop.h"
+
+/**
+ * @brief 构造函数
+ */
+event_loop::event_loop() {
+    m_backend = NULL;
+    m_wakeupfd = -1;
+    m_listenfd = -1;
+    m_LISTENTrigmode = 0;
+    m_pipefd = -1;
+    m_idle_ms = 3 * TIMESLOT * 1000;
+    m_keepalive_requests = 0;
+    m_stop = false;
+    m_started = false;
+    m_pool = NULL;
+    events = NULL;
+    m_sub_loops = NULL;
+    m_sub_num = 0;
+    m_next_sub = 0;
+}
+
+/**
+ * @brief 析构函数，监听套接字和信号管道由 WebServer 负责关闭
+ */
+event_loop::~event_loop() {
+    delete m_backend;
+    if (m_wakeupfd != -1)
+        close(m_wakeupfd);
+    delete[] events;
+}
+
+/**
+ * @brief 初始化事件循环，创建本循环的I/O后端和唤醒用的 eventfd
+ * @param pool 线程池
+ * @param root 根目录
+ * @param conn_trigmode 连接套接字触发模式
+ * @param actor_model 并发模型
+ * @param close_log 关闭日志
+ * @param io_backend I/O后端，0为epoll，1为io_uring
+ * @param keepalive_timeout 连接空闲超时，单位秒
+ * @param keepalive_requests 每个长连接最多处理的请求数，0表示不限制
+ */
+void event_loop::init(threadpool<http_conn> *pool, char *root, int conn_trigmode, int actor_model, int close_log,
+                      int io_backend, int keepalive_timeout, int keepalive_requests) {
+    m_pool = pool;
+    m_root = root;
+    m_CONNTrigmode = conn_trigmode;
+    m_actormodel = actor_model;
+    m_close_log = close_log;
+    m_idle_ms = keepalive_timeout * 1000LL;
+    m_keepalive_requests = keepalive_requests;
+
+    events = new epoll_event[MAX_EVENT_NUMBER];
+    m_ready.reserve(MAX_EVENT_NUMBER);
+    if (1 == io_backend) {
+        //内核不支持io_uring或者所需特性时退回epoll
+        try {
+            m_backend = new uring_backend();
+        } catch (std::exception &e) {
+            LOG_WARN("%s", "io_uring unavailable, fall back to epoll");
+            m_backend = NULL;
+        }
+    }
+    if (!m_backend)
+        m_backend = new epoll_backend();
+
+    //eventfd 计数器被写入后可读，LT 模式下一直通知直到被读空
+    m_wakeupfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(m_wakeupfd != -1);
+    //常驻描述符的data.ptr指向本循环中保存它的成员，用来和连接对象区分
+    m_backend->addfd(m_wakeupfd, &m_wakeupfd, false, 0);
+
+    //reactor模式下工作线程通过完成队列把读写结果交回本循环
+    m_backend->addfd(m_cq.get_fd(), &m_cq, false, 0);
+}
+
+/**
+ * @brief 由本循环负责 accept 的监听套接字
+ * @param listenfd
+ * @param listen_trigmode
+ */
+void event_loop::add_listen(int listenfd, int listen_trigmode) {
+    m_listenfd = listenfd;
+    m_LISTENTrigmode = listen_trigmode;
+    m_backend->add_listen(m_listenfd, &m_listenfd, m_LISTENTrigmode);
+}
+
+/**
+ * @brief 由本循环处理的信号管道读端，只用来接收 SIGTERM
+ * @param pipefd
+ */
+void event_loop::add_signal(int pipefd) {
+    m_pipefd = pipefd;
+    m_backend->addfd(m_pipefd, &m_pipefd, false, 0);
+}
+
+/**
+ * @brief 挂接子Reactor，之后 accept 得到的连接轮询派发给它们
+ * @param sub_loops
+ * @param sub_num
+ */
+void event_loop::set_sub_loops(event_loop *sub_loops, int sub_num) {
+    m_sub_loops = sub_loops;
+    m_sub_num = sub_num;
+}
+
+/**
+ * @brief 子Reactor线程入口
+ * @param arg
+ * @return
+ */
+void *event_loop::worker(void *arg) {
+    //信号统一交给主线程处理，避免子Reactor的等待被 EINTR 打断
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    event_loop *loop = (event_loop *) arg;
+    loop->loop();
+    return loop;
+}
+
+/**
+ * @brief 创建子Reactor线程
+ * @param cpu 大于等于0时把线程绑定到该CPU
+ */
+void event_loop::start(int cpu) {
+    if (pthread_create(&m_thread, NULL, worker, this) != 0)
+        throw std::exception();
+    m_started = true;
+
+    if (cpu >= 0) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(cpu, &cpuset);
+        if (pthread_setaffinity_np(m_thread, sizeof(cpuset), &cpuset) != 0) {
+            LOG_WARN("%s:%d", "set cpu affinity failed", cpu);
+        }
+    }
+}
+
+/**
+ * @brief 通知本循环退出，可以在其他线程调用
+ */
+void event_loop::stop() {
+    m_stop = true;
+    uint64_t one = 1;
+    ::write(m_wakeupfd, &one, sizeof(one));
+}
+
+/**
+ * @brief 等待子Reactor线程退出
+ */
+void event_loop::join() {
+    if (m_started) {
+        pthread_join(m_thread, NULL);
+        m_started = false;
+    }
+}
+
+/**
+ * @brief 主Reactor调用，把新连接交给本循环，由本循环线程完成注册
+ * @param connfd
+ * @param client_address
+ */
+void event_loop::queue_conn(int connfd, const sockaddr_in &client_address) {
+    client_data data;
+    data.address = client_address;
+    data.sockfd = connfd;
+    data.timer = NULL;
+
+    m_pending_lock.lock();
+    m_pending.push_back(data);
+    m_pending_lock.unlock();
+
+    uint64_t one = 1;
+    ::write(m_wakeupfd, &one, sizeof(one));
+}
+
+/**
+ * @brief 进入事件循环，处理连接请求、读写事件和定时器事件
+ */
+void event_loop::loop() {
+    while (!m_stop) {
+        //等待事件的发生，超时时间取最早到期的定时器，没有定时器时一直等待
+        int number = m_backend->wait(events, MAX_EVENT_NUMBER, utils.m_timer_wheel.next_timeout());
+        if (number < 0 && errno != EINTR) {
+            LOG_ERROR("%s", "epoll failure");
+            break;
+        }
+        //请求都经过事件循环派发，醒来时刷新Date，同一秒内只是一次比较
+        date_cache::get_instance()->refresh();
+
+        //遍历所有就绪事件，处理事件
+        for (int i = 0; i < number; i++) {
+            void *ptr = events[i].data.ptr;
+
+            //1.表示有新的客户端连接请求，调用 dealclinetdata() 函数来处理连接请求
+            if (ptr == &m_listenfd) {
+                bool flag = dealclinetdata();
+                if (false == flag)
+                    continue;
+            }
+            //2.主Reactor派发了新连接或者要求退出
+            else if (ptr == &m_wakeupfd) {
+                dealwithwakeup();
+            }
+            //3.工作线程投递了读写结果
+            else if (ptr == &m_cq) {
+                dealwithcompletion();
+            }
+            //4.表示收到了一个信号，调用 dealwithsignal() 函数来处理信号
+            else if (ptr == &m_pipefd) {
+                bool flag = dealwithsignal();
+                if (false == flag)
+                    LOG_ERROR("%s", "dealclientdata failure");
+            }
+            //5.表示客户端连接已经断开，移除对应的定时器，并清理相应的资源
+            else if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                //服务器端关闭连接，移除对应的定时器
+                http_conn *conn = (http_conn *) ptr;
+                deal_timer(conn->m_client_data.timer);
+            }
+            //6.表示客户端有数据到来，调用 dealwithread() 函数来处理客户端请求
+            else if (events[i].events & EPOLLIN) {
+                dealwithread((http_conn *) ptr);
+            }
+            //7.表示服务器端可以向客户端发送数据，调用 dealwithwrite() 函数来发送数据
+            else if (events[i].events & EPOLLOUT) {
+                dealwithwrite((http_conn *) ptr);
+            }
+        }
+        //本轮就绪的请求一起交给线程池，只唤醒一次工作线程
+        submit_ready();
+
+        //处理本循环到期的定时器，一次处理所有已经超时的连接
+        utils.m_timer_wheel.tick();
+    }
+}
+
+/**
+ * @brief accept 得到新连接后，主Reactor轮询派发给子Reactor，单Reactor直接在本循环注册
+ * @param connfd
+ * @param client_address
+ */
+void event_loop::new_conn(int connfd, const sockaddr_in &client_address) {
+    if (m_sub_num > 0) {
+        m_sub_loops[m_next_sub].queue_conn(connfd, client_address);
+        m_next_sub = (m_next_sub + 1) % m_sub_num;
+    } else {
+        timer(connfd, client_address);
+    }
+}
+
+/**
+ * @brief 添加定时器，用来处理客户端连接超时事件
+ * @param connfd
+ * @param client_address
+ */
+void event_loop::timer(int connfd, struct sockaddr_in client_address) {
+    //从连接池取一个连接对象
+    http_conn *conn = m_conns.alloc();
+    conn->init(connfd, client_address, m_root, m_CONNTrigmode, m_close_log, m_backend, &m_cq, m_keepalive_requests);
+
+    //初始化client_data数据
+    //创建定时器，设置回调函数和超时时间，绑定用户数据，将定时器添加到时间轮中
+    client_data *data = &conn->m_client_data;
+    data->address = client_address;
+    data->sockfd = connfd;
+    data->backend = m_backend;
+    data->conn = conn;
+    data->slab = &m_conns;
+    data->idle_ms = m_idle_ms;
+    util_timer *timer = utils.m_timer_wheel.get_timer();
+    timer->user_data = data;
+    timer->cb_func = cb_func;
+    timer->expire = now_ms() + m_idle_ms;
+    data->timer = timer;
+    utils.m_timer_wheel.add_timer(timer);
+}
+
+/**
+ * @brief 调整定时器，每次读写后重新计算空闲超时
+ * @param timer
+ */
+void event_loop::adjust_timer(util_timer *timer) {
+    timer->expire = now_ms() + m_idle_ms;
+    utils.m_timer_wheel.adjust_timer(timer);
+
+    LOG_INFO("%s", "adjust timer once");
+}
+
+/**
+ * @brief 处理定时器事件，用来关闭超时的客户端连接
+ * @param timer
+ */
+void event_loop::deal_timer(util_timer *timer) {
+    //定时器已经到期关闭过连接时没有需要处理的
+    if (!timer)
+        return;
+    //回调会把连接对象还给连接池，先取出描述符
+    int sockfd = timer->user_data->sockfd;
+    //连接还在线程池中时回调只推迟超时时刻，等空闲定时器再次到期时关闭
+    if (timer->cb_func(timer->user_data)) {
+        utils.m_timer_wheel.adjust_timer(timer);
+        return;
+    }
+    utils.m_timer_wheel.del_timer(timer);
+
+    LOG_INFO("close fd %d", sockfd);
+}
+
+/**
+ * @brief 处理客户端连接请求
+ * @return
+ */
+bool event_loop::dealclinetdata() {
+    struct sockaddr_in client_address;
+    if (0 == m_LISTENTrigmode) {    //LT模式
+        //获取到的新客户连接fd
+        int connfd = m_backend->accept(m_listenfd, &client_address);
+        if (connfd < 0) {
+            LOG_ERROR("%s:errno is:%d", "accept error", errno);
+            return false;
+        }
+        //将connfd添加到epollfd中
+        new_conn(connfd, client_address);
+    } else {    //监听socket是ET模式
+        while (1) {
+            int connfd = m_backend->accept(m_listenfd, &client_address);
+            if (connfd < 0) {
+                LOG_ERROR("%s:errno is:%d", "accept error", errno);
+                break;
+            }
+            new_conn(connfd, client_address);
+        }
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief 处理信号事件，定时器不再依赖信号，只剩终止信号
+ * @return
+ */
+bool event_loop::dealwithsignal() {
+    int ret = 0;
+    char signals[1024];
+    ret = recv(m_pipefd, signals, sizeof(signals), 0);
+    if (ret == -1) {
+        return false;
+    } else if (ret == 0) {
+        return false;
+    } else {
+        for (int i = 0; i < ret; ++i) {
+            switch (signals[i]) {
+                case SIGTERM: {
+                    m_stop = true;
+                    break;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief 读空 eventfd，注册主Reactor派发过来的连接
+ */
+void event_loop::dealwithwakeup() {
+    uint64_t count;
+    ::read(m_wakeupfd, &count, sizeof(count));
+
+    std::vector<client_data> pending;
+    m_pending_lock.lock();
+    pending.swap(m_pending);
+    m_pending_lock.unlock();
+
+    for (size_t i = 0; i < pending.size(); ++i)
+        timer(pending[i].sockfd, pending[i].address);
+}
+
+/**
+ * @brief 取出工作线程投递的读写结果，失败的连接在这里删除定时器并关闭
+ */
+void event_loop::dealwithcompletion() {
+    m_cq.drain(m_completions);
+
+    for (size_t i = 0; i < m_completions.size(); ++i) {
+        if (!m_completions[i].close)
+            continue;
+        http_conn *conn = m_completions[i].conn;
+        //定时器可能已经先一步到期关闭了连接，连接对象甚至已经分配给了新连接，代数不同时丢弃
+        if (conn->generation() != m_completions[i].generation)
+            continue;
+        util_timer *timer = conn->m_client_data.timer;
+        if (timer)
+            deal_timer(timer);
+    }
+    m_completions.clear();
+}
+
+/**
+ * @brief 处理读事件，用来读取客户端发送的数据
+ * @param conn
+ */
+void event_loop::dealwithread(http_conn *conn) {
+    util_timer *timer = conn->m_client_data.timer;
+
+    //reactor
+    if (1 == m_actormodel) {
+        if (timer) {
+            adjust_timer(timer);
+        }
+
+        //若监测到读事件，将该事件放入本轮的提交批次，请求还没有读取，先按静态类别排队
+        conn->m_state = 0;
+        conn->m_sched_class = SCHED_STATIC;
+        m_ready.push_back(conn);
+        //不等待工作线程，读取失败时由完成队列通知关闭
+    } else {
+        //proactor
+        if (conn->read_once()) {
+            LOG_INFO("deal with the client(%s)", inet_ntoa(conn->get_address()->sin_addr));
+
+            //若监测到读事件，按请求的路由选择调度类别，放入本轮的提交批次
+            conn->m_sched_class = conn->classify();
+            m_ready.push_back(conn);
+
+            if (timer) {
+                adjust_timer(timer);
+            }
+        } else if (timer) {
+            //定时器可能已经到期关闭过连接
+            deal_timer(timer);
+        }
+    }
+}
+
+/**
+ * @brief 处理写事件，用来向客户端发送数据
+ * @param conn
+ */
+void event_loop::dealwithwrite(http_conn *conn) {
+    util_timer *timer = conn->m_client_data.timer;
+    //reactor
+    if (1 == m_actormodel) {
+        if (timer) {
+            adjust_timer(timer);
+        }
+
+        conn->m_state = 1;
+        conn->m_sched_class = SCHED_STATIC;
+        m_ready.push_back(conn);
+        //不等待工作线程，写入失败时由完成队列通知关闭
+    } else {
+        //proactor
+        if (conn->write()) {
+            LOG_INFO("send data to the client(%s)", inet_ntoa(conn->get_address()->sin_addr));
+
+            if (timer) {
+                adjust_timer(timer);
+            }
+            //读缓冲区中还有流水线请求，直接交给线程池生成下一批响应
+            if (conn->pipelined()) {
+                conn->m_sched_class = conn->classify();
+                m_ready.push_back(conn);
+            }
+        } else if (timer) {
+            //定时器可能已经到期关闭过连接
+            deal_timer(timer);
+        }
+    }
+}
+
+/**
+ * @brief 把本轮收集到的连接成批提交给线程池
+ */
+void event_loop::submit_ready() {
+    if (m_ready.empty())
+        return;
+    //先占用再提交，工作线程可能在提交返回之前就已经处理完
+    for (size_t i = 0; i < m_ready.size(); ++i)
+        m_ready[i]->pin();
+    int accepted = m_pool->append_batch(&m_ready[0], m_ready.size());
+    if (accepted < (int) m_ready.size()) {
+        LOG_WARN("request queue full, %d requests dropped", (int) m_ready.size() - accepted);
+        //没有进入队列的连接不会再有工作线程访问，留给空闲定时器关闭
+        for (size_t i = accepted; i < m_ready.size(); ++i)
+            m_ready[i]->post_completion(false);
+    }
+    m_ready.clear();
+}
@@ -0,0 +1,113 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <cassert>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <vector>
+
+#include "../threadpool/threadpool.h"
+#include "../http/http_conn.h"
+#include "../http/conn_slab.h"
+#include "completion_queue.h"
+#include "event_backend.h"
+#include "uring_backend.h"
+
+const int MAX_EVENT_NUMBER = 10000; //最大事件数
+const int TIMESLOT = 5;             //最小超时单位，默认连接空闲3个TIMESLOT后关闭
+
+//event_loop类，一个epoll实例及其上的连接、定时器，单Reactor时运行在主线程，主从Reactor时每个子Reactor一个线程
+class event_loop {
+public:     //公有成员
+    event_loop();
+
+    ~event_loop();
+
+    void init(threadpool<http_conn> *pool, char *root, int conn_trigmode, int actor_model, int close_log,
+              int io_backend, int keepalive_timeout, int keepalive_requests);
+
+    void add_listen(int listenfd, int listen_trigmode);
+
+    void add_signal(int pipefd);
+
+    void set_sub_loops(event_loop *sub_loops, int sub_num);
+
+    void loop();
+
+    void start(int cpu = -1);
+
+    void stop();
+
+    void join();
+
+    void queue_conn(int connfd, const sockaddr_in &client_address);
+
+private:    //私有成员
+    static void *worker(void *arg);
+
+    void new_conn(int connfd, const sockaddr_in &client_address);
+
+    void timer(int connfd, struct sockaddr_in client_address);
+
+    void adjust_timer(util_timer *timer);
+
+    void deal_timer(util_timer *timer);
+
+    bool dealclinetdata();
+
+    bool dealwithsignal();
+
+    void dealwithwakeup();
+
+    void dealwithcompletion();
+
+    void dealwithread(http_conn *conn);
+
+    void dealwithwrite(http_conn *conn);
+
+    void submit_ready();
+
+private:    //私有成员
+    event_backend *m_backend;   //本循环的I/O多路复用后端，epoll或io_uring
+    int m_wakeupfd;             //eventfd，主Reactor派发新连接或停止时用来唤醒本循环
+    int m_listenfd;             //监听套接字，子Reactor为-1
+    int m_LISTENTrigmode;       //监听套接字的触发模式
+    int m_pipefd;               //信号管道读端，只有主循环持有
+    int m_CONNTrigmode;         //连接套接字的触发模式
+    int m_actormodel;           //并发模型
+    int m_close_log;            //是否关闭日志
+    char *m_root;               //Web 服务器的根目录
+    long long m_idle_ms;        //连接空闲超时，单位毫秒
+    int m_keepalive_requests;   //每个长连接最多处理的请求数，0表示不限制
+    volatile bool m_stop;       //停止标志
+    pthread_t m_thread;         //子Reactor线程
+    bool m_started;             //是否已经创建子Reactor线程
+
+    conn_slab m_conns;          //本循环的连接对象池，就绪事件的data.ptr直接指向其中的连接
+    threadpool<http_conn> *m_pool;  //线程池
+    epoll_event *events;        //就绪事件数组
+    Utils utils;                //本循环独立的定时器时间轮，下一个要处理的刻度决定等待超时
+
+    event_loop *m_sub_loops;    //主Reactor上挂接的子Reactor，单Reactor时为NULL
+    int m_sub_num;              //子Reactor数量
+    int m_next_sub;             //轮询派发的下一个子Reactor
+
+    completion_queue m_cq;                  //reactor模式下工作线程投递读写结果的完成队列
+    std::vector<completion> m_completions;  //每轮从完成队列取出的结果
+    std::vector<http_conn *> m_ready;       //本轮要交给线程池的连接，处理完所有就绪事件后一起提交
+
+    locker m_pending_lock;                  //保护待接管连接队列
+    std::vector<client_data> m_pending;     //主Reactor派发过来、尚未注册的连接
+};
+
+#endif
@@ -0,0 +1,646 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <exception>
+#include "uring_backend.h"
+
+/**
+ * @brief 构造函数，创建io_uring实例并映射提交队列和完成队列，内核不支持时抛出异常
+ * @param entries 提交队列长度
+ */
+uring_backend::uring_backend(unsigned entries) {
+    m_sq_ptr = MAP_FAILED;
+    m_cq_ptr = MAP_FAILED;
+    m_sqes = (io_uring_sqe *) MAP_FAILED;
+    m_has_loop_thread = false;
+    m_listenfd = -1;
+    m_listen_ptr = NULL;
+    m_buf_ring = NULL;
+    m_bufs = NULL;
+    m_staged = NULL;
+
+    //按进程可打开的描述符上限建表，calloc得到的大块内存按页惰性清零，只有用到的描述符占用物理内存
+    struct rlimit rl;
+    m_max_fd = 65536;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0)
+        m_max_fd = (rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur > (1 << 20)) ? (1 << 20) : (int) rl.rlim_cur;
+    m_gen = (unsigned *) calloc(m_max_fd, sizeof(unsigned));
+    m_ptr = (void **) calloc(m_max_fd, sizeof(void *));
+    m_sends = (linked_send *) calloc(m_max_fd, sizeof(linked_send));
+
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    //每个连接最多挂一个poll请求，完成队列放大一些，溢出时内核也会暂存(IORING_FEAT_NODROP)
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = entries * 4;
+    m_ringfd = syscall(__NR_io_uring_setup, entries, &p);
+    if (m_ringfd < 0) {
+        free(m_gen);
+        free(m_ptr);
+        free(m_sends);
+        throw std::exception();
+    }
+
+    //multishot accept、按描述符取消、等待超时分别需要5.19、5.19、5.11以上的内核
+    if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP)) {
+        close(m_ringfd);
+        free(m_gen);
+        free(m_ptr);
+        free(m_sends);
+        throw std::exception();
+    }
+
+    m_sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    m_cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (m_cq_size > m_sq_size)
+            m_sq_size = m_cq_size;
+        m_cq_size = m_sq_size;
+    }
+
+    m_sq_ptr = mmap(0, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringfd, IORING_OFF_SQ_RING);
+    if (m_sq_ptr == MAP_FAILED) {
+        close(m_ringfd);
+        free(m_gen);
+        free(m_ptr);
+        free(m_sends);
+        throw std::exception();
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        m_cq_ptr = m_sq_ptr;
+    } else {
+        m_cq_ptr = mmap(0, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringfd,
+                        IORING_OFF_CQ_RING);
+        if (m_cq_ptr == MAP_FAILED) {
+            munmap(m_sq_ptr, m_sq_size);
+            close(m_ringfd);
+            free(m_gen);
+            free(m_ptr);
+            free(m_sends);
+            throw std::exception();
+        }
+    }
+    m_sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = (io_uring_sqe *) mmap(0, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringfd,
+                                   IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED) {
+        if (m_cq_ptr != m_sq_ptr)
+            munmap(m_cq_ptr, m_cq_size);
+        munmap(m_sq_ptr, m_sq_size);
+        close(m_ringfd);
+        free(m_gen);
+        free(m_ptr);
+        free(m_sends);
+        throw std::exception();
+    }
+
+    char *sq = (char *) m_sq_ptr;
+    m_sq_head = (unsigned *) (sq + p.sq_off.head);
+    m_sq_tail = (unsigned *) (sq + p.sq_off.tail);
+    m_sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+    m_sq_entries = (unsigned *) (sq + p.sq_off.ring_entries);
+    m_sq_array = (unsigned *) (sq + p.sq_off.array);
+
+    char *cq = (char *) m_cq_ptr;
+    m_cq_head = (unsigned *) (cq + p.cq_off.head);
+    m_cq_tail = (unsigned *) (cq + p.cq_off.tail);
+    m_cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+    m_cqes = (io_uring_cqe *) (cq + p.cq_off.cqes);
+
+    setup_buf_ring();
+}
+
+/**
+ * @brief 注册接收缓冲区环，需要5.19以上的内核，不支持时连接的读事件仍然使用poll
+ */
+void uring_backend::setup_buf_ring() {
+    m_buf_ring_size = BUF_COUNT * sizeof(io_uring_buf);
+    void *ring = mmap(NULL, m_buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+        return;
+    void *bufs = mmap(NULL, BUF_COUNT * BUF_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    m_staged = (staged_buf *) calloc(m_max_fd, sizeof(staged_buf));
+    if (bufs == MAP_FAILED || !m_staged) {
+        munmap(ring, m_buf_ring_size);
+        if (bufs != MAP_FAILED)
+            munmap(bufs, BUF_COUNT * BUF_SIZE);
+        free(m_staged);
+        m_staged = NULL;
+        return;
+    }
+
+    //注册前先写一遍，内核固定的是已经分配的页面，否则tail的修改内核看不到
+    memset(ring, 0, m_buf_ring_size);
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long) ring;
+    reg.ring_entries = BUF_COUNT;
+    reg.bgid = BUF_GROUP;
+    if (syscall(__NR_io_uring_register, m_ringfd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        munmap(ring, m_buf_ring_size);
+        munmap(bufs, BUF_COUNT * BUF_SIZE);
+        free(m_staged);
+        m_staged = NULL;
+        return;
+    }
+
+    m_buf_ring = (io_uring_buf *) ring;
+    m_bufs = (char *) bufs;
+    for (unsigned i = 0; i < BUF_COUNT; ++i)
+        recycle_buf(i);
+}
+
+/**
+ * @brief 把一个接收缓冲区还给内核，调用者必须持有m_buf_lock
+ * 环的tail就是第一项的resv字段(io_uring_buf_ring)，所以只写addr、len、bid
+ * @param bid
+ */
+void uring_backend::recycle_buf(unsigned bid) {
+    unsigned short *tail = &m_buf_ring[0].resv;
+    io_uring_buf *buf = &m_buf_ring[*tail & (BUF_COUNT - 1)];
+    buf->addr = (unsigned long) (m_bufs + (size_t) bid * BUF_SIZE);
+    buf->len = BUF_SIZE;
+    buf->bid = (unsigned short) bid;
+    __atomic_store_n(tail, (unsigned short) (*tail + 1), __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief 丢弃描述符上没有读走的数据，归还缓冲区
+ * @param fd
+ */
+void uring_backend::drop_staged(int fd) {
+    if (!m_buf_ring || fd < 0 || fd >= m_max_fd)
+        return;
+    staged_buf *staged = &m_staged[fd];
+    if (staged->off < staged->len) {
+        m_buf_lock.lock();
+        recycle_buf(staged->bid);
+        m_buf_lock.unlock();
+    }
+    staged->off = 0;
+    staged->len = 0;
+}
+
+/**
+ * @brief 析构函数，关闭io_uring实例时内核会取消所有未完成的请求
+ */
+uring_backend::~uring_backend() {
+    for (size_t i = 0; i < m_accepted.size(); ++i)
+        close(m_accepted[i]);
+    munmap(m_sqes, m_sqes_size);
+    if (m_cq_ptr != m_sq_ptr)
+        munmap(m_cq_ptr, m_cq_size);
+    munmap(m_sq_ptr, m_sq_size);
+    close(m_ringfd);
+    //实例关闭后内核不再往接收缓冲区写数据
+    if (m_buf_ring) {
+        munmap(m_buf_ring, m_buf_ring_size);
+        munmap(m_bufs, BUF_COUNT * BUF_SIZE);
+        free(m_staged);
+    }
+    free(m_gen);
+    free(m_ptr);
+    free(m_sends);
+}
+
+/**
+ * @brief 调用io_uring_enter
+ * @return
+ */
+int uring_backend::enter(unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz) {
+    return syscall(__NR_io_uring_enter, m_ringfd, to_submit, min_complete, flags, arg, argsz);
+}
+
+/**
+ * @brief 是否在事件循环线程中调用
+ * @return
+ */
+bool uring_backend::in_loop_thread() {
+    return m_has_loop_thread && pthread_equal(m_loop_thread, pthread_self());
+}
+
+/**
+ * @brief 描述符当前的代数，只保留24位
+ * @param fd
+ * @return
+ */
+unsigned uring_backend::get_gen(int fd) {
+    if (fd < 0 || fd >= m_max_fd)
+        return 0;
+    return __atomic_load_n(&m_gen[fd], __ATOMIC_ACQUIRE) & 0xffffff;
+}
+
+/**
+ * @brief 取一个空闲的提交队列项，调用者必须持有m_sq_lock，队列满时先提交一次
+ * @param offset 一次准备多项时，取tail之后的第几项，这些项由调用者一起发布
+ * @return
+ */
+io_uring_sqe *uring_backend::get_sqe(unsigned offset) {
+    unsigned tail = *m_sq_tail;
+    unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    if (tail + offset - head >= *m_sq_entries) {
+        enter(tail - head, 0, 0, NULL, 0);
+        head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+        if (tail + offset - head >= *m_sq_entries)
+            return NULL;
+    }
+    unsigned index = (tail + offset) & *m_sq_mask;
+    io_uring_sqe *sqe = &m_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sq_array[index] = index;
+    //写完sqe内容后再发布tail，由调用者填写完毕后调用
+    return sqe;
+}
+
+/**
+ * @brief 提交一个poll请求，连接用单次poll，常驻描述符用multishot poll
+ * @param fd
+ * @param mask
+ * @param multishot
+ */
+void uring_backend::queue_poll(int fd, unsigned mask, bool multishot) {
+    m_sq_lock.lock();
+    io_uring_sqe *sqe = get_sqe();
+    if (sqe) {
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll32_events = mask;
+        if (multishot)
+            sqe->len = IORING_POLL_ADD_MULTI;
+        sqe->user_data = ((__u64) (multishot ? REQ_POLL_MULTI : REQ_POLL) << 56) |
+                         ((__u64) get_gen(fd) << 32) | (unsigned) fd;
+        __atomic_store_n(m_sq_tail, *m_sq_tail + 1, __ATOMIC_RELEASE);
+    }
+    //事件循环线程里的注册随下一次wait一起提交，工作线程里的注册要立即提交，否则事件循环一直阻塞看不到
+    if (!in_loop_thread())
+        enter(1, 0, 0, NULL, 0);
+    m_sq_lock.unlock();
+}
+
+/**
+ * @brief 提交multishot accept请求
+ * @param listenfd
+ */
+void uring_backend::queue_accept(int listenfd) {
+    m_sq_lock.lock();
+    io_uring_sqe *sqe = get_sqe();
+    if (sqe) {
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listenfd;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK;
+        sqe->user_data = ((__u64) REQ_ACCEPT << 56) | (unsigned) listenfd;
+        __atomic_store_n(m_sq_tail, *m_sq_tail + 1, __ATOMIC_RELEASE);
+    }
+    m_sq_lock.unlock();
+}
+
+/**
+ * @brief 填写连接的读请求，内核从接收缓冲区组中选一个缓冲区接收数据
+ * 没有接收缓冲区时用单次poll，上次接收的数据没有读完时不能再接收，否则会打乱顺序，用NOP直接产生读事件
+ * @param sqe
+ * @param fd
+ */
+void uring_backend::prep_read(io_uring_sqe *sqe, int fd) {
+    int type = REQ_RECV;
+    if (!m_buf_ring) {
+        type = REQ_POLL;
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll32_events = POLLIN | POLLRDHUP;
+    } else if (m_staged[fd].off < m_staged[fd].len) {
+        type = REQ_READY;
+        sqe->opcode = IORING_OP_NOP;
+    } else {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fd;
+        sqe->len = BUF_SIZE;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUF_GROUP;
+    }
+    sqe->user_data = ((__u64) type << 56) | ((__u64) get_gen(fd) << 32) | (unsigned) fd;
+}
+
+/**
+ * @brief 提交连接的读请求
+ * @param fd
+ */
+void uring_backend::queue_recv(int fd) {
+    m_sq_lock.lock();
+    io_uring_sqe *sqe = get_sqe();
+    if (sqe) {
+        prep_read(sqe, fd);
+        __atomic_store_n(m_sq_tail, *m_sq_tail + 1, __ATOMIC_RELEASE);
+    }
+    if (!in_loop_thread())
+        enter(1, 0, 0, NULL, 0);
+    m_sq_lock.unlock();
+}
+
+/**
+ * @brief 注册描述符的读事件并设置非阻塞，io_uring的poll是水平语义，ET模式下读到EAGAIN的逻辑同样适用
+ * @param fd
+ * @param ptr 就绪时通过data.ptr返回
+ * @param one_shot
+ * @param TRIGMode
+ */
+void uring_backend::addfd(int fd, void *ptr, bool one_shot, int) {
+    int old_option = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, old_option | O_NONBLOCK);
+    if (fd >= 0 && fd < m_max_fd)
+        m_ptr[fd] = ptr;
+
+    //连接的读事件直接接收数据，常驻描述符由各自的处理函数读取，仍然用poll
+    if (one_shot && m_buf_ring && fd >= 0 && fd < m_max_fd)
+        queue_recv(fd);
+    else
+        queue_poll(fd, POLLIN | POLLRDHUP, !one_shot);
+}
+
+/**
+ * @brief 重新注册单次poll，有接收缓冲区时读事件改为提交接收
+ * @param fd
+ * @param ptr 与addfd时相同，保存在m_ptr中
+ * @param ev
+ * @param TRIGMode
+ */
+void uring_backend::modfd(int fd, void *, int ev, int) {
+    if (EPOLLIN == ev && m_buf_ring && fd >= 0 && fd < m_max_fd) {
+        queue_recv(fd);
+        return;
+    }
+    queue_poll(fd, ev | POLLRDHUP, false);
+}
+
+/**
+ * @brief 取消描述符上未完成的poll后关闭
+ * 挂起的请求持有文件引用，只close的话套接字不会真正关闭，所以取消请求必须在close之前提交
+ * @param fd
+ */
+void uring_backend::removefd(int fd) {
+    drop_staged(fd);
+
+    m_sq_lock.lock();
+    io_uring_sqe *sqe = get_sqe();
+    if (sqe) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = fd;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        sqe->user_data = ((__u64) REQ_CANCEL << 56) | (unsigned) fd;
+        __atomic_store_n(m_sq_tail, *m_sq_tail + 1, __ATOMIC_RELEASE);
+    }
+    if (fd >= 0 && fd < m_max_fd)
+        __atomic_add_fetch(&m_gen[fd], 1, __ATOMIC_RELEASE);
+    unsigned pending = *m_sq_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    enter(pending, 0, 0, NULL, 0);
+    m_sq_lock.unlock();
+
+    close(fd);
+}
+
+/**
+ * @brief 注册监听套接字，使用multishot accept
+ * @param listenfd
+ * @param ptr
+ * @param TRIGMode
+ */
+void uring_backend::add_listen(int listenfd, void *ptr, int) {
+    int old_option = fcntl(listenfd, F_GETFL);
+    fcntl(listenfd, F_SETFL, old_option | O_NONBLOCK);
+
+    m_listenfd = listenfd;
+    m_listen_ptr = ptr;
+    queue_accept(listenfd);
+}
+
+/**
+ * @brief 取出multishot accept已经得到的新连接
+ * @param listenfd
+ * @param client_address
+ * @return
+ */
+int uring_backend::accept(int listenfd, struct sockaddr_in *client_address) {
+    if (listenfd != m_listenfd || m_accepted.empty()) {
+        errno = EAGAIN;
+        return -1;
+    }
+    int connfd = m_accepted.front();
+    m_accepted.pop_front();
+
+    //multishot accept的多个完成共用一个地址缓冲区，这里单独查询对端地址
+    socklen_t client_addrlength = sizeof(*client_address);
+    getpeername(connfd, (struct sockaddr *) client_address, &client_addrlength);
+    return connfd;
+}
+
+/**
+ * @brief 提交积累的请求并等待完成，把完成结果转换为epoll_event
+ * @param events
+ * @param max_events
+ * @param timeout_ms
+ * @return
+ */
+int uring_backend::wait(epoll_event *events, int max_events, int timeout_ms) {
+    if (!m_has_loop_thread) {
+        m_loop_thread = pthread_self();
+        m_has_loop_thread = true;
+    }
+
+    m_sq_lock.lock();
+    unsigned to_submit = *m_sq_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    m_sq_lock.unlock();
+
+    //还有没取走的新连接时不阻塞
+    unsigned min_complete = m_accepted.empty() ? 1 : 0;
+    int ret;
+    if (timeout_ms >= 0) {
+        struct __kernel_timespec ts;
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long long) (timeout_ms % 1000) * 1000000;
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = (__u64) (unsigned long) &ts;
+        ret = enter(to_submit, min_complete, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    } else {
+        ret = enter(to_submit, min_complete, IORING_ENTER_GETEVENTS, NULL, _NSIG / 8);
+    }
+    int saved_errno = errno;
+    if (ret < 0 && saved_errno != ETIME && saved_errno != EINTR && saved_errno != EBUSY && saved_errno != EAGAIN)
+        return -1;
+
+    //留一个位置给监听套接字的就绪事件
+    int number = 0;
+    unsigned head = *m_cq_head;
+    unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail && number < max_events - 1) {
+        io_uring_cqe *cqe = &m_cqes[head & *m_cq_mask];
+        int type = (int) (cqe->user_data >> 56);
+        unsigned gen = (unsigned) (cqe->user_data >> 32) & 0xffffff;
+        int fd = (int) (cqe->user_data & 0xffffffff);
+        int res = cqe->res;
+        bool more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+        ++head;
+
+        if (REQ_POLL == type || REQ_POLL_MULTI == type) {
+            //描述符在完成之后已经被关闭，可能已经分配给了新连接
+            if (fd >= m_max_fd || gen != get_gen(fd))
+                continue;
+            if (res > 0) {
+                events[number].data.ptr = m_ptr[fd];
+                events[number].events = (unsigned) res;
+                ++number;
+            }
+            //multishot poll被内核终止时重新注册，被取消的不再注册
+            if (REQ_POLL_MULTI == type && !more && res != -ECANCELED)
+                queue_poll(fd, POLLIN | POLLRDHUP, true);
+        } else if (REQ_RECV == type || REQ_READY == type) {
+            bool has_buf = (cqe->flags & IORING_CQE_F_BUFFER) != 0;
+            unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            //描述符已经被关闭时收到的数据直接丢弃，缓冲区还给内核
+            if (fd >= m_max_fd || gen != get_gen(fd) || res == -ECANCELED) {
+                if (has_buf) {
+                    m_buf_lock.lock();
+                    recycle_buf(bid);
+                    m_buf_lock.unlock();
+                }
+                continue;
+            }
+            //缓冲区用完时请求立即失败，不代表有数据，改用poll等待可读后由连接自己从套接字读取
+            if (-ENOBUFS == res) {
+                queue_poll(fd, POLLIN | POLLRDHUP, false);
+                continue;
+            }
+            events[number].data.ptr = m_ptr[fd];
+            if (has_buf && res > 0) {
+                m_staged[fd].bid = bid;
+                m_staged[fd].off = 0;
+                m_staged[fd].len = (unsigned) res;
+                events[number].events = EPOLLIN;
+            } else if (REQ_READY == type) {
+                events[number].events = EPOLLIN;
+            } else if (0 == res) {
+                events[number].events = EPOLLIN | EPOLLRDHUP;
+            } else {
+                events[number].events = EPOLLERR;
+            }
+            ++number;
+        } else if (REQ_SEND == type) {
+            //全部发完时链接的读请求已经开始执行，不产生事件；没有发完时读请求被内核取消，交给连接继续发送
+            if (fd >= m_max_fd || gen != get_gen(fd) || res == m_sends[fd].len)
+                continue;
+            m_sends[fd].res = res;
+            events[number].data.ptr = m_ptr[fd];
+            events[number].events = (res >= 0 || -EAGAIN == res) ? EPOLLOUT : EPOLLERR;
+            ++number;
+        } else if (REQ_ACCEPT == type) {
+            if (res >= 0)
+                m_accepted.push_back(res);
+            if (!more && res != -ECANCELED)
+                queue_accept(fd);
+        }
+    }
+    __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+
+    if (!m_accepted.empty()) {
+        events[number].data.ptr = m_listen_ptr;
+        events[number].events = EPOLLIN;
+        ++number;
+    }
+
+    if (number == 0 && ret < 0 && saved_errno == EINTR) {
+        errno = EINTR;
+        return -1;
+    }
+    return number;
+}
+
+/**
+ * @brief 读取连接上的数据，先取走RECV已经接收到缓冲区中的部分，没有时直接从套接字读取
+ * 读完一个缓冲区后立即还给内核
+ * @param fd
+ * @param iov
+ * @param iovcnt
+ * @return
+ */
+ssize_t uring_backend::readv(int fd, const struct iovec *iov, int iovcnt) {
+    if (!m_buf_ring || fd < 0 || fd >= m_max_fd || m_staged[fd].off == m_staged[fd].len)
+        return ::readv(fd, iov, iovcnt);
+
+    staged_buf *staged = &m_staged[fd];
+    const char *data = m_bufs + (size_t) staged->bid * BUF_SIZE;
+    ssize_t copied = 0;
+    for (int i = 0; i < iovcnt && staged->off < staged->len; ++i) {
+        size_t n = staged->len - staged->off;
+        if (n > iov[i].iov_len)
+            n = iov[i].iov_len;
+        memcpy(iov[i].iov_base, data + staged->off, n);
+        staged->off += n;
+        copied += n;
+    }
+    if (staged->off == staged->len)
+        drop_staged(fd);
+    return copied;
+}
+
+/**
+ * @brief 提交WRITEV发送响应，用IOSQE_IO_LINK链接下一次读请求，两项一起发布
+ * 套接字是非阻塞的，WRITEV在提交时就执行完毕，没有发完时内核取消链接的读请求
+ * @param fd
+ * @param iov
+ * @param iovcnt
+ * @return 提交队列已满时返回false，由调用者改用可写事件发送
+ */
+bool uring_backend::send_linked(int fd, const struct iovec *iov, int iovcnt) {
+    if (fd < 0 || fd >= m_max_fd)
+        return false;
+    int len = 0;
+    for (int i = 0; i < iovcnt; ++i)
+        len += iov[i].iov_len;
+    m_sends[fd].len = len;
+    m_sends[fd].res = 0;
+
+    m_sq_lock.lock();
+    io_uring_sqe *send = get_sqe(0);
+    io_uring_sqe *read = send ? get_sqe(1) : NULL;
+    if (!read) {
+        m_sq_lock.unlock();
+        return false;
+    }
+    send->opcode = IORING_OP_WRITEV;
+    send->fd = fd;
+    send->addr = (unsigned long) iov;
+    send->len = iovcnt;
+    send->flags = IOSQE_IO_LINK;
+    send->user_data = ((__u64) REQ_SEND << 56) | ((__u64) get_gen(fd) << 32) | (unsigned) fd;
+    prep_read(read, fd);
+    __atomic_store_n(m_sq_tail, *m_sq_tail + 2, __ATOMIC_RELEASE);
+    if (!in_loop_thread())
+        enter(2, 0, 0, NULL, 0);
+    m_sq_lock.unlock();
+    return true;
+}
+
+/**
+ * @brief 取出没有发完的WRITEV的结果
+ * @param fd
+ * @return 已发送的字节数，失败时返回-1并设置errno
+ */
+ssize_t uring_backend::linked_result(int fd) {
+    int res = (fd >= 0 && fd < m_max_fd) ? m_sends[fd].res : -EINVAL;
+    if (res < 0) {
+        errno = -res;
+        return -1;
+    }
+    return res;
+}
@@ -0,0 +1,129 @@
+#ifndef URING_BACKEND_H
+#define URING_BACKEND_H
+
+#include <pthread.h>
+#include <deque>
+#include <linux/io_uring.h>
+#include "event_backend.h"
+#include "../lock/locker.h"
+
+//uring_backend类，基于io_uring的后端
+//连接用单次POLL_ADD代替EPOLLONESHOT，重新注册只是往提交队列写一项，随下一次等待一起提交，不再需要epoll_ctl
+//监听套接字用multishot accept，一次提交持续产生新连接
+//内核支持时注册一组接收缓冲区，连接的读事件直接提交RECV，就绪时数据已经在缓冲区中，连接读取时只需拷贝
+//响应用WRITEV异步发送，并用IOSQE_IO_LINK链接下一次读请求，发完之后内核直接开始接收下一个请求
+class uring_backend : public event_backend {
+public:     //公有成员
+    uring_backend(unsigned entries = 4096);
+
+    ~uring_backend();
+
+    void addfd(int fd, void *ptr, bool one_shot, int TRIGMode);
+
+    void modfd(int fd, void *ptr, int ev, int TRIGMode);
+
+    void removefd(int fd);
+
+    void add_listen(int listenfd, void *ptr, int TRIGMode);
+
+    int accept(int listenfd, struct sockaddr_in *client_address);
+
+    int wait(epoll_event *events, int max_events, int timeout_ms);
+
+    ssize_t readv(int fd, const struct iovec *iov, int iovcnt);
+
+    bool send_linked(int fd, const struct iovec *iov, int iovcnt);
+
+    ssize_t linked_result(int fd);
+
+private:    //私有成员
+    static const int BUF_GROUP = 0;         //接收缓冲区组号
+    static const unsigned BUF_COUNT = 256;  //接收缓冲区个数，必须是2的幂
+    static const unsigned BUF_SIZE = 4096;  //每个接收缓冲区的大小
+
+    //RECV收到、还没有被连接读走的数据
+    struct staged_buf {
+        unsigned bid;   //缓冲区编号
+        unsigned off;   //已经读走的字节数
+        unsigned len;   //收到的字节数，与off相等表示没有数据
+    };
+
+    //send_linked提交的发送
+    struct linked_send {
+        int len;        //要发送的字节数
+        int res;        //没有发完时的完成结果，已发送的字节数或负的错误码
+    };
+
+    //user_data高8位表示请求类型，中间24位是描述符的代数，低32位是描述符
+    enum REQ_TYPE {
+        REQ_POLL = 1,       //单次poll，对应EPOLLONESHOT连接
+        REQ_POLL_MULTI,     //multishot poll，对应eventfd、信号管道等常驻描述符
+        REQ_ACCEPT,         //multishot accept
+        REQ_CANCEL,         //取消描述符上的所有请求
+        REQ_RECV,           //从接收缓冲区组中选择缓冲区的单次接收，对应连接的读事件
+        REQ_READY,          //NOP，连接还有没读完的已接收数据，直接产生读事件
+        REQ_SEND            //链接了读请求的WRITEV
+    };
+
+    void setup_buf_ring();
+
+    io_uring_sqe *get_sqe(unsigned offset = 0);
+
+    void queue_poll(int fd, unsigned mask, bool multishot);
+
+    void queue_accept(int listenfd);
+
+    void prep_read(io_uring_sqe *sqe, int fd);
+
+    void queue_recv(int fd);
+
+    void recycle_buf(unsigned bid);
+
+    void drop_staged(int fd);
+
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz);
+
+    bool in_loop_thread();
+
+    unsigned get_gen(int fd);
+
+private:    //私有成员
+    int m_ringfd;               //io_uring实例
+    void *m_sq_ptr;             //提交队列映射
+    size_t m_sq_size;
+    void *m_cq_ptr;             //完成队列映射，SINGLE_MMAP时与提交队列相同
+    size_t m_cq_size;
+    io_uring_sqe *m_sqes;       //提交队列项数组
+    size_t m_sqes_size;
+
+    unsigned *m_sq_head;
+    unsigned *m_sq_tail;
+    unsigned *m_sq_mask;
+    unsigned *m_sq_entries;
+    unsigned *m_sq_array;
+    unsigned *m_cq_head;
+    unsigned *m_cq_tail;
+    unsigned *m_cq_mask;
+    io_uring_cqe *m_cqes;
+
+    locker m_sq_lock;           //工作线程也会重新注册事件，提交队列需要互斥
+    pthread_t m_loop_thread;    //调用wait的事件循环线程
+    bool m_has_loop_thread;
+
+    unsigned *m_gen;            //每个描述符关闭一次代数加一，丢弃描述符被复用前残留的完成结果
+    void **m_ptr;               //每个描述符注册时传入的指针，转换为epoll_event时填入data.ptr
+    int m_max_fd;
+
+    io_uring_buf *m_buf_ring;   //注册给内核的接收缓冲区环，内核不支持时为NULL
+    size_t m_buf_ring_size;
+    char *m_bufs;               //BUF_COUNT个接收缓冲区
+    locker m_buf_lock;          //工作线程读完数据后也会归还缓冲区
+    staged_buf *m_staged;       //每个描述符上已接收、未读走的数据
+    linked_send *m_sends;       //每个描述符上send_linked提交的发送
+
+    int m_listenfd;             //multishot accept的监听套接字
+    void *m_listen_ptr;         //监听套接字注册时传入的指针
+    std::deque<int> m_accepted; //已经accept但还没被事件循环取走的连接
+};
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef MPMC_RING_H
+#define MPMC_RING_H
+
+#include <stddef.h>
+#include <atomic>
+
+//mpmc_ring类，Vyukov有界多生产者多消费者环形队列
+//每个槽位带一个序号，生产者和消费者各自用CAS推进一个位置计数，不加锁，队列满或空时立即返回
+//批量接口一次CAS占用连续的多个槽位，容量不要求是2的幂
+template<typename T>
+class mpmc_ring {
+public:
+    mpmc_ring() : m_cells(NULL), m_capacity(0), m_enqueue(0), m_dequeue(0) {}
+
+    ~mpmc_ring() {
+        delete[] m_cells;
+    }
+
+    /**
+     * @brief 分配槽位，第i个槽位的序号初始为i，表示可以写入位置i
+     * @param capacity 容量
+     */
+    void init(size_t capacity) {
+        m_capacity = capacity;
+        m_cells = new cell[capacity];
+        for (size_t i = 0; i < capacity; ++i) {
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+            m_cells[i].data = NULL;
+        }
+    }
+
+    /**
+     * @brief 压入最多n个元素，占用的槽位连续，保持传入的顺序
+     * @param items
+     * @param n
+     * @return 实际压入的个数，队列满时可能少于n
+     */
+    int push_batch(T *const *items, int n) {
+        size_t pos = m_enqueue.load(std::memory_order_relaxed);
+        while (true) {
+            //从pos开始数出连续的空槽位，序号等于位置表示上一轮的元素已经被取走
+            int count = 0;
+            while (count < n && m_cells[(pos + count) % m_capacity].seq.load(std::memory_order_acquire) ==
+                                pos + count)
+                ++count;
+            if (count == 0) {
+                //第一个槽位不空：要么队列满，要么位置已经被其它生产者推进
+                size_t now = m_enqueue.load(std::memory_order_relaxed);
+                if (now == pos)
+                    return 0;
+                pos = now;
+                continue;
+            }
+            //一次CAS占用count个槽位，失败时pos被更新为最新位置
+            if (m_enqueue.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed))
+                n = count;
+            else
+                continue;
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            cell &c = m_cells[(pos + i) % m_capacity];
+            c.data = items[i];
+            //序号加一，消费者看到后才能读取数据
+            c.seq.store(pos + i + 1, std::memory_order_release);
+        }
+        return n;
+    }
+
+    /**
+     * @brief 取出最多n个元素，按压入的顺序
+     * @param items
+     * @param n
+     * @return 实际取出的个数，队列空时为0
+     */
+    int pop_batch(T **items, int n) {
+        size_t pos = m_dequeue.load(std::memory_order_relaxed);
+        while (true) {
+            //从pos开始数出连续的已写入槽位
+            int count = 0;
+            while (count < n && m_cells[(pos + count) % m_capacity].seq.load(std::memory_order_acquire) ==
+                                pos + count + 1)
+                ++count;
+            if (count == 0) {
+                size_t now = m_dequeue.load(std::memory_order_relaxed);
+                if (now == pos)
+                    return 0;
+                pos = now;
+                continue;
+            }
+            if (m_dequeue.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed))
+                n = count;
+            else
+                continue;
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            cell &c = m_cells[(pos + i) % m_capacity];
+            items[i] = c.data;
+            //序号推进一整圈，表示下一轮的生产者可以写入
+            c.seq.store(pos + i + m_capacity, std::memory_order_release);
+        }
+        return n;
+    }
+
+    //任意线程调用，队列中元素数的瞬间估计
+    size_t size() const {
+        size_t enqueue = m_enqueue.load(std::memory_order_relaxed);
+        size_t dequeue = m_dequeue.load(std::memory_order_relaxed);
+        return enqueue > dequeue ? enqueue - dequeue : 0;
+    }
+
+private:    //私有成员
+    struct cell {
+        std::atomic<size_t> seq;    //等于位置时可写入，等于位置加一时可读取
+        T *data;
+    };
+
+    cell *m_cells;                  //槽位数组
+    size_t m_capacity;              //容量
+    char m_pad0[64];
+    std::atomic<size_t> m_enqueue;  //下一个写入位置，生产者之间竞争
+    char m_pad1[64];
+    std::atomic<size_t> m_dequeue;  //下一个读取位置，消费者之间竞争
+    char m_pad2[64];
+};
+
+#endif
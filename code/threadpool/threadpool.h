@@ -1,19 +1,76 @@
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
 
-#include <list>
 #include <cstdio>
 #include <exception>
+#include <atomic>
+#include <time.h>
 #include <pthread.h>
 #include "../lock/locker.h"
-#include "../CGImysql/sql_connection_pool.h"
+#include "../log/log.h"
+#include "work_deque.h"
+#include "mpmc_ring.h"
 
-//类模板的模板参数为 T，表示任务类型
+//请求队列的调度方式
+enum QUEUE_MODE {
+    QUEUE_WORK_STEALING = 0,    //每个线程一个收件箱和一个双端队列，空闲线程窃取
+    QUEUE_RING                  //所有线程共享一个有界环形队列
+};
+
+//请求的调度类别，每个类别一个队列，并给其它类别保留一定数量的线程
+enum SCHED_CLASS {
+    SCHED_STATIC = 0,           //静态文件等很快完成的请求，使用QUEUE_MODE选择的队列
+    SCHED_DB,                   //登录、注册等会阻塞在数据库上的请求
+    SCHED_ADMIN,                //管理接口，优先于其它类别
+    SCHED_CLASS_NUM
+};
+
+//工作线程取任务时检查各类别的顺序，管理接口最先，数据库最后
+const int SCHED_ORDER[SCHED_CLASS_NUM] = {SCHED_ADMIN, SCHED_STATIC, SCHED_DB};
+
+const int MAX_BATCH = 8;        //工作线程一次从环形队列取出的最多任务数
+
+//线程池的运行统计，get_stats返回一份快照
+struct pool_stats {
+    int threads;                //当前工作线程数
+    int min_threads;            //最少工作线程数
+    int max_threads;            //最多工作线程数
+    int queued;                 //排队的任务数，瞬间的估计
+    int class_queued[SCHED_CLASS_NUM];  //各类别排队的任务数
+    int class_running[SCHED_CLASS_NUM]; //各类别正在执行任务的线程数
+    long long tasks;            //累计执行的任务数
+    long long avg_wait_us;      //累计平均排队时间，单位微秒
+    long long max_wait_us;      //上次get_stats以来的最长排队时间，单位微秒
+    long long spawned;          //累计因为排队时间过长而增加的线程数
+    long long retired;          //累计因为空闲而退出的线程数
+};
+
+/**
+ * @brief 单调时钟的当前微秒数，用来统计排队时间和空闲时间
+ * @return
+ */
+inline long long pool_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+//类模板的模板参数为 T，表示任务类型，T需要有T *m_task_next成员，用来串起收件箱中的任务，
+//long long m_enqueue_us成员，记录进入请求队列的时刻，int m_sched_class成员，提交前设置为SCHED_CLASS，
+//以及classify()，reactor模式下读取请求之后重新判断调度类别
+//工作窃取调度：每个工作线程有一个收件箱和一个双端队列，没有全局锁
+//事件循环把任务压入某个线程的收件箱，工作线程把收件箱整批转入自己的双端队列，空闲时从其它线程窃取
+//环形队列调度：所有线程共享一个Vyukov有界队列，提交和取出都可以成批进行，结构更简单
+//线程数在min_threads和max_threads之间伸缩：任务排队时间超过目标时增加一个线程，编号最大的线程空闲超过冷却时间后退出
+//数据库和管理类别的请求各有一个共享环形队列，一个类别最多占用的线程数是总线程数减去给其它类别保留的线程数，
+//数据库变慢时阻塞在数据库上的线程不会超过这个配额，静态请求始终有保留的线程处理
 template<typename T>
 class threadpool {
 public:
-    /*thread_number是线程池中线程的数量，max_requests是请求队列中最多允许的、等待处理的请求的数量*/
-    threadpool(int actor_model, connection_pool *connPool, int thread_number = 8, int max_request = 10000);
+    /*thread_number是线程池中线程的数量，max_requests是请求队列中最多允许的、等待处理的请求的数量，也是环形队列的容量*/
+    threadpool(int actor_model, int thread_number = 8, int max_request = 10000,
+               int queue_mode = QUEUE_WORK_STEALING, int max_threads = 0, int wait_target_ms = 20,
+               int idle_timeout_s = 30, const int *reserved = NULL, int close_log = 0);
 
     ~threadpool();
 
@@ -21,21 +78,91 @@ public:
 
     bool append_p(T *request);
 
+    int append_batch(T *const *requests, int n);
+
+    void get_stats(pool_stats *stats);
+
 private:
+    //每个可能的工作线程一份，按最多线程数预先分配，运行中的线程总是占用编号最小的若干个
+    struct worker_slot {
+        threadpool *pool;           //所属线程池
+        int id;                     //线程编号
+        pthread_t thread;           //线程ID
+        bool started;               //是否创建过线程、需要join，只在m_grow_lock保护下访问
+        std::atomic<T *> inbox;     //生产者压入的任务，按m_task_next串成链表，表头是最后压入的
+        std::atomic<long long> busy_since;  //正在执行的任务开始的时刻，空闲时为0
+        std::atomic<long long> tasks;       //本线程执行的任务数，只有本线程写
+        std::atomic<long long> wait_sum;    //这些任务的排队时间之和
+        std::atomic<long long> wait_max;    //最长排队时间，get_stats读取后清零
+        char pad[64];               //收件箱和双端队列放在不同的缓存行
+        work_deque<T> deque;        //本线程待处理的任务，自己从底部取，其它线程从顶部窃取
+    };
+
     /*工作线程运行的函数，它不断从工作队列中取出任务并执行之*/
     static void *worker(void *arg);
 
-    void run();
+    void run(worker_slot *self);
+
+    int push(T *const *requests, int n);
+
+    int enqueue(int sched_class, T *const *requests, int n);
+
+    int take(worker_slot *self, T **batch, int *sched_class);
+
+    int take_class(worker_slot *self, int sched_class, T **batch);
+
+    int limit(int sched_class);
+
+    int queued(int sched_class);
+
+    bool reroute(T *request);
+
+    T *take_one(worker_slot *self);
+
+    bool refill(worker_slot *self, worker_slot *from);
+
+    bool has_work();
+
+    bool park(worker_slot *self, long long idle_since);
+
+    bool retire(worker_slot *self);
+
+    void notify(int n);
+
+    bool start(int id);
+
+    void grow();
+
+    void check_stall(long long now);
+
+    void handle(T *request);
+
+    void stop();
 
 private:
-    int m_thread_number;        //线程池中的线程数
+    int m_thread_number;        //最少的线程数，也是启动时创建的线程数
+    int m_max_threads;          //最多的线程数
     int m_max_requests;         //请求队列中允许的最大请求数
-    pthread_t *m_threads;       //描述线程池的数组，其大小为m_thread_number
-    std::list<T *> m_workqueue; //请求队列
-    locker m_queuelocker;       //保护请求队列的互斥锁
-    sem m_queuestat;            //是否有任务需要处理
-    connection_pool *m_connPool;//数据库
+    worker_slot *m_workers;     //每个工作线程的收件箱和双端队列，共m_max_threads个
+    std::atomic<int> m_active;  //运行中的线程数，占用编号[0, m_active)
+    std::atomic<int> m_high;    //创建过线程的最大编号加一，窃取和检查时只扫描这些
+    long long m_wait_target_us; //排队时间目标，超过时增加线程
+    long long m_idle_us;        //空闲超过这么久的线程退出
+    std::atomic<long long> m_last_grow; //上次增加线程的时刻，两次增加至少间隔一个排队时间目标
+    std::atomic<long long> m_spawned;   //累计增加的线程数
+    std::atomic<long long> m_retired;   //累计退出的线程数
+    locker m_grow_lock;         //创建线程和析构时的join互斥
+    int m_queue_mode;           //调度方式，QUEUE_MODE
+    mpmc_ring<T> m_rings[SCHED_CLASS_NUM];  //各类别的环形队列，静态类别只在环形队列调度时使用
+    int m_reserved[SCHED_CLASS_NUM];        //给各类别保留的线程数，其它类别不能占用
+    std::atomic<int> m_running[SCHED_CLASS_NUM];    //各类别正在执行任务的线程数
+    std::atomic<int> m_pending; //工作窃取调度时已提交、尚未被工作线程取走的任务数
+    std::atomic<unsigned> m_next;   //下一个接收任务的收件箱，轮询分配
+    std::atomic<int> m_sleepers;    //正在休眠或准备休眠的线程数，为0时提交任务不进入内核
+    futex m_idle;               //空闲的工作线程在这里休眠
+    std::atomic<bool> m_stop;   //析构时通知工作线程退出
     int m_actor_model;          //模型切换
+    int m_close_log;            //是否关闭日志
 };
 
 
@@ -43,39 +170,68 @@ private:
  * @brief 构造函数，用于初始化线程池
  * @tparam T
  * @param actor_model 模型切换
- * @param connPool 数据库连接池
- * @param thread_number 线程数量
+ * @param thread_number 最少的线程数量，启动时创建这么多线程
  * @param max_requests 请求队列中允许的最大请求数
+ * @param queue_mode 调度方式
+ * @param max_threads 最多的线程数量，不大于thread_number时线程数固定
+ * @param wait_target_ms 排队时间目标，单位毫秒
+ * @param idle_timeout_s 多出的线程空闲超过这么多秒后退出
+ * @param reserved 给各调度类别保留的线程数，共SCHED_CLASS_NUM个，NULL表示都不保留
+ * @param close_log 是否关闭日志
  */
 template<typename T>
-threadpool<T>::threadpool(int actor_model, connection_pool *connPool, int thread_number, int max_requests)
-        : m_actor_model(actor_model), m_thread_number(thread_number), m_max_requests(max_requests), m_threads(NULL),
-          m_connPool(connPool) {
+threadpool<T>::threadpool(int actor_model, int thread_number, int max_requests,
+                          int queue_mode, int max_threads, int wait_target_ms, int idle_timeout_s,
+                          const int *reserved, int close_log)
+        : m_actor_model(actor_model), m_thread_number(thread_number), m_max_requests(max_requests),
+          m_workers(NULL), m_active(0), m_high(0), m_last_grow(0), m_spawned(0), m_retired(0),
+          m_queue_mode(queue_mode), m_pending(0), m_next(0), m_sleepers(0), m_stop(false),
+          m_close_log(close_log) {
     if (thread_number <= 0 || max_requests <= 0)
         throw std::exception();
+    m_max_threads = max_threads > thread_number ? max_threads : thread_number;
+    m_wait_target_us = (wait_target_ms > 0 ? wait_target_ms : 1) * 1000LL;
+    m_idle_us = (idle_timeout_s > 0 ? idle_timeout_s : 1) * 1000000LL;
+    for (int c = 0; c < SCHED_CLASS_NUM; ++c) {
+        m_reserved[c] = reserved && reserved[c] > 0 ? reserved[c] : 0;
+        m_running[c].store(0, std::memory_order_relaxed);
+    }
 
-    //使用new动态分配了一个大小为thread_number的pthread_t数组，用于存放线程ID
-    m_threads = new pthread_t[m_thread_number];
-
-    if (!m_threads)
-        throw std::exception();
+    //排队的任务总数不超过max_requests，每个双端队列按这个容量分配就不会覆盖未取走的任务
+    m_workers = new worker_slot[m_max_threads];
+    for (int i = 0; i < m_max_threads; ++i) {
+        m_workers[i].pool = this;
+        m_workers[i].id = i;
+        m_workers[i].started = false;
+        m_workers[i].inbox.store(NULL, std::memory_order_relaxed);
+        m_workers[i].busy_since.store(0, std::memory_order_relaxed);
+        m_workers[i].tasks.store(0, std::memory_order_relaxed);
+        m_workers[i].wait_sum.store(0, std::memory_order_relaxed);
+        m_workers[i].wait_max.store(0, std::memory_order_relaxed);
+        if (QUEUE_RING != m_queue_mode)
+            m_workers[i].deque.init(max_requests + 1);
+    }
+    //静态类别在工作窃取调度时使用各线程的收件箱和双端队列，其它类别总是使用共享环形队列
+    for (int c = 0; c < SCHED_CLASS_NUM; ++c) {
+        if (SCHED_STATIC != c || QUEUE_RING == m_queue_mode)
+            m_rings[c].init(max_requests);
+    }
 
     //循环创建thread_number个工作线程
+    m_grow_lock.lock();
     for (int i = 0; i < thread_number; ++i) {
-
-        //具体的，首先使用pthread_create函数创建一个线程，将该线程的ID存储在m_threads数组中
-        if (pthread_create(m_threads + i, NULL, worker, this) != 0) {
-            //如果创建线程失败，将m_threads数组释放，然后抛出异常
-            delete[] m_threads;
-            throw std::exception();
-        }
-
-        //使用pthread_detach函数将该线程设置为分离状态，这样的话，当线程执行结束后，系统会自动回收该线程所占用的资源
-        if (pthread_detach(m_threads[i])) {
-            delete[] m_threads;
+        //先计入运行中的线程数，新线程启动后立即可以按它分配任务
+        m_active.store(i + 1);
+        //工作线程访问线程池的成员，不再分离，析构时等待它们退出
+        if (!start(i)) {
+            //如果创建线程失败，让已经创建的线程退出，然后抛出异常
+            m_grow_lock.unlock();
+            stop();
+            delete[] m_workers;
             throw std::exception();
         }
     }
+    m_grow_lock.unlock();
 }
 
 /**
@@ -84,8 +240,147 @@ threadpool<T>::threadpool(int actor_model, connection_pool *connPool, int thread
  */
 template<typename T>
 threadpool<T>::~threadpool() {
-    //释放线程数组所占用的内存
-    delete[] m_threads;
+    stop();
+    //释放每个线程的队列所占用的内存
+    delete[] m_workers;
+}
+
+/**
+ * @brief 唤醒所有工作线程并等待它们退出，还没有处理的任务直接丢弃
+ * @tparam T
+ */
+template<typename T>
+void threadpool<T>::stop() {
+    //持有m_grow_lock设置停止标志，之后不会再创建新线程
+    m_grow_lock.lock();
+    m_stop.store(true);
+    m_idle.wake(m_max_threads);
+    for (int i = 0; i < m_max_threads; ++i) {
+        if (m_workers[i].started) {
+            pthread_join(m_workers[i].thread, NULL);
+            m_workers[i].started = false;
+        }
+    }
+    m_grow_lock.unlock();
+}
+
+/**
+ * @brief 在编号为id的槽位上创建工作线程，调用者持有m_grow_lock
+ * 该槽位上次的线程已经退出或者正在退出，先回收它
+ * @tparam T
+ * @param id
+ * @return
+ */
+template<typename T>
+bool threadpool<T>::start(int id) {
+    worker_slot *slot = &m_workers[id];
+    if (slot->started) {
+        pthread_join(slot->thread, NULL);
+        slot->started = false;
+    }
+    if (pthread_create(&slot->thread, NULL, worker, slot) != 0)
+        return false;
+    slot->started = true;
+    if (m_high.load(std::memory_order_relaxed) < id + 1)
+        m_high.store(id + 1, std::memory_order_release);
+    return true;
+}
+
+/**
+ * @brief 增加一个工作线程，两次增加之间至少间隔一个排队时间目标，让新线程先分担一段时间
+ * @tparam T
+ */
+template<typename T>
+void threadpool<T>::grow() {
+    int n = m_active.load(std::memory_order_relaxed);
+    if (n >= m_max_threads)
+        return;
+    long long now = pool_now_us();
+    long long last = m_last_grow.load(std::memory_order_relaxed);
+    if (now - last < m_wait_target_us || !m_last_grow.compare_exchange_strong(last, now))
+        return;
+
+    m_grow_lock.lock();
+    n = m_active.load();
+    //先占住编号再创建线程，编号最大的线程此时不会退出
+    while (!m_stop.load() && n < m_max_threads && !m_active.compare_exchange_weak(n, n + 1));
+    if (!m_stop.load() && n < m_max_threads) {
+        if (start(n)) {
+            m_spawned.fetch_add(1, std::memory_order_relaxed);
+            LOG_INFO("threadpool grow to %d threads", n + 1);
+        } else {
+            m_active.fetch_sub(1);
+            LOG_ERROR("%s", "threadpool create thread failed");
+        }
+    }
+    m_grow_lock.unlock();
+}
+
+/**
+ * @brief 所有运行中的线程都在同一个任务上停留超过排队时间目标时增加线程
+ * 线程都阻塞在数据库之类的操作上时没有线程取任务，排队时间只能在提交时发现
+ * @tparam T
+ * @param now
+ */
+template<typename T>
+void threadpool<T>::check_stall(long long now) {
+    if (now - m_last_grow.load(std::memory_order_relaxed) < m_wait_target_us)
+        return;
+    int n = m_active.load(std::memory_order_relaxed);
+    for (int i = 0; i < n; ++i) {
+        long long since = m_workers[i].busy_since.load(std::memory_order_relaxed);
+        if (0 == since || now - since < m_wait_target_us)
+            return;
+    }
+    grow();
+}
+
+/**
+ * @brief 编号最大的线程空闲超时后退出，运行中的线程始终占用连续的编号
+ * @tparam T
+ * @param self
+ * @return 成功退出时返回true
+ */
+template<typename T>
+bool threadpool<T>::retire(worker_slot *self) {
+    int n = self->id + 1;
+    if (n <= m_thread_number || !m_active.compare_exchange_strong(n, n - 1))
+        return false;
+    m_retired.fetch_add(1, std::memory_order_relaxed);
+    LOG_INFO("threadpool shrink to %d threads", n - 1);
+    return true;
+}
+
+/**
+ * @brief 读取运行统计，各线程的计数分别累加，最长排队时间读取后清零
+ * @tparam T
+ * @param stats
+ */
+template<typename T>
+void threadpool<T>::get_stats(pool_stats *stats) {
+    stats->threads = m_active.load();
+    stats->min_threads = m_thread_number;
+    stats->max_threads = m_max_threads;
+    stats->queued = 0;
+    for (int c = 0; c < SCHED_CLASS_NUM; ++c) {
+        stats->class_queued[c] = queued(c);
+        stats->class_running[c] = m_running[c].load(std::memory_order_relaxed);
+        stats->queued += stats->class_queued[c];
+    }
+    stats->tasks = 0;
+    stats->max_wait_us = 0;
+    long long wait_sum = 0;
+    int high = m_high.load(std::memory_order_acquire);
+    for (int i = 0; i < high; ++i) {
+        stats->tasks += m_workers[i].tasks.load(std::memory_order_relaxed);
+        wait_sum += m_workers[i].wait_sum.load(std::memory_order_relaxed);
+        long long max = m_workers[i].wait_max.exchange(0, std::memory_order_relaxed);
+        if (max > stats->max_wait_us)
+            stats->max_wait_us = max;
+    }
+    stats->avg_wait_us = stats->tasks > 0 ? wait_sum / stats->tasks : 0;
+    stats->spawned = m_spawned.load(std::memory_order_relaxed);
+    stats->retired = m_retired.load(std::memory_order_relaxed);
 }
 
 /**
@@ -97,21 +392,9 @@ threadpool<T>::~threadpool() {
  */
 template<typename T>
 bool threadpool<T>::append(T *request, int state) {
-    //先对工作队列进行加锁
-    m_queuelocker.lock();
-    //判断队列中任务数量是否已达到最大限制
-    if (m_workqueue.size() >= m_max_requests) {
-        //则解锁并返回 false
-        m_queuelocker.unlock();
-        return false;
-    }
-    //将传入的请求 request 加入队列尾部，设置请求的状态为 state
+    //设置请求的状态为 state，随任务一起发布给工作线程
     request->m_state = state;
-    m_workqueue.push_back(request);
-    //解锁并发送信号通知工作线程有新任务需要处理
-    m_queuelocker.unlock();
-    m_queuestat.post();
-    return true;
+    return push(&request, 1) == 1;
 }
 
 /**
@@ -122,90 +405,411 @@ bool threadpool<T>::append(T *request, int state) {
  */
 template<typename T>
 bool threadpool<T>::append_p(T *request) {
-    //对请求队列上锁
-    m_queuelocker.lock();
-    if (m_workqueue.size() >= m_max_requests) {
-        //解锁并返回false
-        m_queuelocker.unlock();
-        return false;
+    return push(&request, 1) == 1;
+}
+
+/**
+ * @brief 成批添加任务，事件循环一轮收集到的请求一起提交，只唤醒一次
+ * reactor模式下调用者先设置好每个请求的m_state
+ * @tparam T
+ * @param requests
+ * @param n
+ * @return 实际添加的任务数，队列满时少于n
+ */
+template<typename T>
+int threadpool<T>::append_batch(T *const *requests, int n) {
+    return n > 0 ? push(requests, n) : 0;
+}
+
+/**
+ * @brief 把任务按调度类别放入各自的请求队列，有线程休眠时唤醒
+ * 相邻的同类别任务一起放入，某一段没有全部放入时停止，保证放入的是前面的若干个任务
+ * @tparam T
+ * @param requests
+ * @param n
+ * @return 实际放入的任务数
+ */
+template<typename T>
+int threadpool<T>::push(T *const *requests, int n) {
+    //记录进入队列的时刻，工作线程取出时计算排队时间
+    long long now = pool_now_us();
+    for (int i = 0; i < n; ++i)
+        requests[i]->m_enqueue_us = now;
+    int accepted = 0;
+    while (accepted < n) {
+        int sched_class = requests[accepted]->m_sched_class;
+        int run = 1;
+        while (accepted + run < n && requests[accepted + run]->m_sched_class == sched_class)
+            ++run;
+        int k = enqueue(sched_class, requests + accepted, run);
+        accepted += k;
+        if (k < run)
+            break;
     }
-    //将请求加入队列，解锁并将信号量m_queuestat的值加1，表示有新任务需要处理
-    m_workqueue.push_back(request);
-    m_queuelocker.unlock();
-    m_queuestat.post();
-    return true;
+    if (accepted > 0) {
+        notify(accepted);
+        //没有空闲线程时检查是否所有线程都被卡住
+        if (m_max_threads > m_thread_number && 0 == m_sleepers.load(std::memory_order_relaxed))
+            check_stall(now);
+    }
+    return accepted;
+}
+
+/**
+ * @brief 把同一类别的若干个任务放入该类别的队列
+ * 工作窃取调度时静态类别整批串成链表，一次CAS压入下一个线程的收件箱，收件箱是无锁栈，取出时整批交换，不存在ABA问题
+ * @tparam T
+ * @param sched_class
+ * @param requests
+ * @param n
+ * @return 实际放入的任务数
+ */
+template<typename T>
+int threadpool<T>::enqueue(int sched_class, T *const *requests, int n) {
+    if (SCHED_STATIC != sched_class || QUEUE_RING == m_queue_mode)
+        return m_rings[sched_class].push_batch(requests, n);
+    //判断排队的任务数量是否已达到最大限制，超出的部分不接受
+    int old = m_pending.fetch_add(n, std::memory_order_relaxed);
+    int accepted = old >= m_max_requests ? 0 : (m_max_requests - old < n ? m_max_requests - old : n);
+    if (accepted < n)
+        m_pending.fetch_sub(n - accepted, std::memory_order_relaxed);
+    n = accepted;
+    if (n == 0)
+        return 0;
+    //链表头是最后提交的任务
+    for (int i = 1; i < n; ++i)
+        requests[i]->m_task_next = requests[i - 1];
+    worker_slot *slot = &m_workers[m_next.fetch_add(1, std::memory_order_relaxed) %
+                                   m_active.load(std::memory_order_relaxed)];
+    T *head = slot->inbox.load(std::memory_order_relaxed);
+    do {
+        requests[0]->m_task_next = head;
+    } while (!slot->inbox.compare_exchange_weak(head, requests[n - 1], std::memory_order_release,
+                                                std::memory_order_relaxed));
+    return n;
+}
+
+/**
+ * @brief 一个类别最多同时占用的线程数：运行中的线程数减去给其它类别保留的线程数，至少为1
+ * @tparam T
+ * @param sched_class
+ * @return
+ */
+template<typename T>
+int threadpool<T>::limit(int sched_class) {
+    int n = m_active.load(std::memory_order_relaxed);
+    for (int c = 0; c < SCHED_CLASS_NUM; ++c) {
+        if (c != sched_class)
+            n -= m_reserved[c];
+    }
+    return n > 1 ? n : 1;
+}
+
+/**
+ * @brief 一个类别排队的任务数，瞬间的估计，不会把有任务的队列报告为空
+ * @tparam T
+ * @param sched_class
+ * @return
+ */
+template<typename T>
+int threadpool<T>::queued(int sched_class) {
+    if (SCHED_STATIC != sched_class || QUEUE_RING == m_queue_mode)
+        return (int) m_rings[sched_class].size();
+    return m_pending.load(std::memory_order_relaxed);
 }
 
 /**
  * @brief 工作线程运行的函数，它不断从工作队列中取出任务并执行之
  * @tparam T
- * @param arg
+ * @param arg 该线程的worker_slot
  * @return
  */
 template<typename T>
 void *threadpool<T>::worker(void *arg) {
-    //将arg转换成线程池指针pool
-    threadpool *pool = (threadpool *) arg;
+    worker_slot *slot = (worker_slot *) arg;
     //调用pool的run函数
-    pool->run();
-    return pool;
+    slot->pool->run(slot);
+    return slot->pool;
 }
 
 /**
- * @brief 主要运行逻辑,不断从工作队列中取出任务并执行之
+ * @brief 主要运行逻辑,不断取出任务并执行之，没有任务时休眠，空闲太久时退出
+ * 每个任务开始前统计排队时间，超过目标时增加线程
  * @tparam T
+ * @param self
  */
 template<typename T>
-void threadpool<T>::run() {
-    while (true) {
-        //消费者
-        //1.通过信号量 m_queuestat 来阻塞线程，直到有任务需要处理
-        m_queuestat.wait(); //sem
-        //2.获取工作队列的互斥锁 m_queuelocker，如果工作队列为空，立即释放互斥锁并继续等待信号量
-        m_queuelocker.lock();//lock
+void threadpool<T>::run(worker_slot *self) {
+    T *batch[MAX_BATCH];
+    long long idle_since = 0;
+    while (!m_stop.load(std::memory_order_relaxed)) {
+        int sched_class;
+        int n = take(self, batch, &sched_class);
+        if (n == 0) {
+            if (0 == idle_since)
+                idle_since = pool_now_us();
+            if (!park(self, idle_since))
+                return;
+            continue;
+        }
+        idle_since = 0;
+        for (int i = 0; i < n; ++i) {
+            long long now = pool_now_us();
+            long long wait = now - batch[i]->m_enqueue_us;
+            self->tasks.store(self->tasks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            self->wait_sum.store(self->wait_sum.load(std::memory_order_relaxed) + wait, std::memory_order_relaxed);
+            if (wait > self->wait_max.load(std::memory_order_relaxed))
+                self->wait_max.store(wait, std::memory_order_relaxed);
+            if (wait > m_wait_target_us)
+                grow();
+            self->busy_since.store(now, std::memory_order_relaxed);
+            handle(batch[i]);
+            self->busy_since.store(0, std::memory_order_relaxed);
+        }
+        m_running[sched_class].fetch_sub(1);
+        //达到配额时休眠的线程没有取这个类别的任务，让出名额后唤醒一个
+        if (SCHED_STATIC != sched_class && queued(sched_class) > 0)
+            notify(1);
+    }
+}
 
-        if (m_workqueue.empty()) {
-            m_queuelocker.unlock();
+/**
+ * @brief 按SCHED_ORDER的顺序取出一个类别的若干个任务，占用该类别的一个名额，类别达到配额时跳过
+ * @tparam T
+ * @param self
+ * @param batch 至少能放MAX_BATCH个任务
+ * @param sched_class 取出的任务所属的类别，执行完后由调用者归还名额
+ * @return 取出的任务数，没有可以执行的任务时为0
+ */
+template<typename T>
+int threadpool<T>::take(worker_slot *self, T **batch, int *sched_class) {
+    for (int k = 0; k < SCHED_CLASS_NUM; ++k) {
+        int c = SCHED_ORDER[k];
+        if (0 == queued(c))
+            continue;
+        if (m_running[c].fetch_add(1) >= limit(c)) {
+            m_running[c].fetch_sub(1);
             continue;
         }
+        int n = take_class(self, c, batch);
+        if (n > 0) {
+            *sched_class = c;
+            return n;
+        }
+        m_running[c].fetch_sub(1);
+    }
+    return 0;
+}
+
+/**
+ * @brief 从一个类别的队列中取出若干个任务
+ * 环形队列调度时静态请求每次最多取排队任务的平均份额，突发的一批请求分散到多个线程，而不是被第一个醒来的线程全部取走
+ * 数据库和管理类别的任务可能很慢，每次只取一个，排在后面的任务不用跟着等待
+ * @tparam T
+ * @param self
+ * @param sched_class
+ * @param batch
+ * @return 取出的任务数
+ */
+template<typename T>
+int threadpool<T>::take_class(worker_slot *self, int sched_class, T **batch) {
+    if (SCHED_STATIC != sched_class)
+        return m_rings[sched_class].pop_batch(batch, 1);
+    if (QUEUE_RING == m_queue_mode) {
+        int share = (int) (m_rings[SCHED_STATIC].size() / m_active.load(std::memory_order_relaxed));
+        return m_rings[SCHED_STATIC].pop_batch(batch, share < 1 ? 1 : (share > MAX_BATCH ? MAX_BATCH : share));
+    }
+    batch[0] = take_one(self);
+    if (!batch[0])
+        return 0;
+    m_pending.fetch_sub(1, std::memory_order_relaxed);
+    return 1;
+}
+
+/**
+ * @brief 取一个任务：先取自己的双端队列，再取自己的收件箱，最后从其它线程窃取
+ * 已经退出的线程的收件箱里可能还有提交时选中它的任务，也一起扫描
+ * @tparam T
+ * @param self
+ * @return 所有队列都为空时返回NULL
+ */
+template<typename T>
+T *threadpool<T>::take_one(worker_slot *self) {
+    T *request = self->deque.pop();
+    if (request)
+        return request;
+    if (refill(self, self))
+        return self->deque.pop();
+    //先窃取其它线程双端队列顶部的任务，再整批取走它们还没有转入双端队列的任务
+    int high = m_high.load(std::memory_order_acquire);
+    for (int k = 1; k < high; ++k) {
+        request = m_workers[(self->id + k) % high].deque.steal();
+        if (request)
+            return request;
+    }
+    for (int k = 1; k < high; ++k) {
+        if (refill(self, &m_workers[(self->id + k) % high]))
+            return self->deque.pop();
+    }
+    return NULL;
+}
 
-        //3.从工作队列中取出一个任务 request 并从队列中删除
-        T *request = m_workqueue.front(); //返回容器中的第一个元素
-        m_workqueue.pop_front();          //删除容器中的第一个元素
+/**
+ * @brief 把from收件箱中的任务整批转入self的双端队列
+ * 链表头是最后压入的任务，依次压入后最早的任务在底部，pop按到达顺序取出，窃取者取走的是较新的任务
+ * @tparam T
+ * @param self
+ * @param from
+ * @return 收件箱为空时返回false
+ */
+template<typename T>
+bool threadpool<T>::refill(worker_slot *self, worker_slot *from) {
+    if (!from->inbox.load(std::memory_order_relaxed))
+        return false;
+    T *list = from->inbox.exchange(NULL, std::memory_order_acquire);
+    if (!list)
+        return false;
+    bool batch = list->m_task_next != NULL;
+    while (list) {
+        T *next = list->m_task_next;
+        self->deque.push(list);
+        list = next;
+    }
+    //一次转入多个任务时唤醒一个休眠的线程来窃取
+    if (batch)
+        notify(1);
+    return true;
+}
 
-        //4.释放工作队列的互斥锁
-        m_queuelocker.unlock();
-        if (!request)
+/**
+ * @brief 休眠前检查各类别的队列，工作窃取调度时检查所有收件箱和双端队列
+ * 达到配额的类别不算，这些任务由正在执行该类别的线程让出名额后接着处理
+ * @tparam T
+ * @return
+ */
+template<typename T>
+bool threadpool<T>::has_work() {
+    for (int c = 0; c < SCHED_CLASS_NUM; ++c) {
+        if (m_running[c].load(std::memory_order_relaxed) >= limit(c))
             continue;
-        //5.根据 actor_model 的值来确定任务的处理方式
-        if (1 == m_actor_model) {   //reactor
-            //如果是 1，则表示使用 reactor 模式，需要根据任务的状态来确定是读取数据还是写入数据
-            if (0 == request->m_state) {    //读事件
-                if (request->read_once()) {
-                    //如果是读取数据，则先进行一次读取，如果读取成功则调用 request->process() 处理请求
-                    request->improv = 1;
-                    connectionRAII mysqlcon(&request->mysql, m_connPool);
-                    request->process();
-                } else {
-                    //否则将 timer_flag 置为 1，表示需要定时关闭请求
-                    request->improv = 1;
-                    request->timer_flag = 1;
-                }
+        if (SCHED_STATIC != c || QUEUE_RING == m_queue_mode) {
+            if (m_rings[c].size() > 0)
+                return true;
+            continue;
+        }
+        int high = m_high.load(std::memory_order_acquire);
+        for (int i = 0; i < high; ++i) {
+            if (m_workers[i].inbox.load(std::memory_order_relaxed) || !m_workers[i].deque.empty())
+                return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief 没有任务时在futex上休眠，线程数可以伸缩时最多睡到空闲超时
+ * 先读futex的值并登记为休眠者，再检查一遍队列和停止标志：之后提交的任务或者析构一定会改变futex的值，不会丢失唤醒
+ * @tparam T
+ * @param self
+ * @param idle_since 本线程开始空闲的时刻
+ * @return 本线程因为空闲超时退出时返回false
+ */
+template<typename T>
+bool threadpool<T>::park(worker_slot *self, long long idle_since) {
+    int epoch = m_idle.load();
+    m_sleepers.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool retired = false;
+    if (!has_work() && !m_stop.load(std::memory_order_relaxed)) {
+        if (m_max_threads > m_thread_number) {
+            long long left = idle_since + m_idle_us - pool_now_us();
+            if (left <= 0 && retire(self))
+                retired = true;
+            else
+                m_idle.wait(epoch, (int) ((left > 0 ? left : m_idle_us) / 1000 + 1));
+        } else {
+            m_idle.wait(epoch);
+        }
+    }
+    m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+    if (retired) {
+        //提交者可能把本线程算作休眠者而没有唤醒别的线程，退出前发现任务就转交出去
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (has_work())
+            notify(1);
+    }
+    return !retired;
+}
+
+/**
+ * @brief 新任务可见之后调用，有线程休眠时唤醒，一批任务也只进入内核一次
+ * @tparam T
+ * @param n 新任务数，最多唤醒这么多线程
+ */
+template<typename T>
+void threadpool<T>::notify(int n) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int sleepers = m_sleepers.load(std::memory_order_relaxed);
+    if (sleepers > 0)
+        m_idle.wake(n < sleepers ? n : sleepers);
+}
+
+/**
+ * @brief reactor模式下读写事件都作为静态类别提交，读到请求之后才知道它的类别
+ * 不是静态类别时改为状态2放入所属类别的队列，让出当前的静态名额，队列满时就地处理
+ * @tparam T
+ * @param request
+ * @return 放入其它队列时返回true，之后不能再访问request
+ */
+template<typename T>
+bool threadpool<T>::reroute(T *request) {
+    int sched_class = request->classify();
+    if (SCHED_STATIC == sched_class)
+        return false;
+    request->m_sched_class = sched_class;
+    request->m_state = 2;
+    return push(&request, 1) == 1;
+}
+
+/**
+ * @brief 执行一个任务
+ * @tparam T
+ * @param request
+ */
+template<typename T>
+void threadpool<T>::handle(T *request) {
+    //根据 actor_model 的值来确定任务的处理方式
+    if (1 == m_actor_model) {   //reactor
+        //如果是 1，则表示使用 reactor 模式，需要根据任务的状态来确定是读取数据还是写入数据
+        if (0 == request->m_state) {    //读事件
+            if (request->read_once()) {
+                //如果是读取数据，则先进行一次读取，如果读取成功则调用 request->process() 处理请求
+                if (reroute(request))
+                    return;
+                request->post_completion(!request->process());
             } else {
-                if (request->write()) {     //写事件
-                    //如果是写入数据，则进行一次写操作,如果写入成功则将 request->improv 置为 1，表示请求已经被处理
-                    request->improv = 1;
-                } else {
-                    //否则将 timer_flag 置为 1，表示需要定时关闭请求
-                    request->improv = 1;
-                    request->timer_flag = 1;
-                }
+                //否则通知事件循环删除定时器并关闭连接
+                request->post_completion(true);
             }
+        } else if (2 == request->m_state) {
+            //已经读取、在所属类别的队列中排过队的请求，直接处理
+            request->post_completion(!request->process());
         } else {
-            //如果是其它值，则表示使用 proactor 模式，直接调用 request->process() 处理请求
-            connectionRAII mysqlcon(&request->mysql, m_connPool);
-            request->process();
+            //写事件，写入失败或者短连接写完时通知事件循环关闭连接
+            bool write_ret = request->write();
+            if (write_ret && request->pipelined()) {
+                //读缓冲区中还有流水线请求，接着生成下一批响应
+                if (reroute(request))
+                    return;
+                request->post_completion(!request->process());
+            } else {
+                request->post_completion(!write_ret);
+            }
         }
+    } else {
+        //如果是其它值，则表示使用 proactor 模式，直接调用 request->process() 处理请求
+        //数据库连接由需要它的处理函数自己获取，静态请求不再经过连接池
+        request->post_completion(!request->process());
     }
 }
 
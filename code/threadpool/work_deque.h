@@ -0,0 +1,97 @@
+#ifndef WORK_DEQUE_H
+#define WORK_DEQUE_H
+
+#include <atomic>
+
+//work_deque类，Chase–Lev工作窃取双端队列
+//只有所属的工作线程在底部push和pop，其它线程在顶部steal，只有取最后一个元素或者窃取时需要CAS
+//容量固定为2的幂，由线程池保证队列中的任务数不超过容量，不需要扩容
+template<typename T>
+class work_deque {
+public:
+    work_deque() : m_top(0), m_bottom(0), m_mask(0), m_buf(NULL) {}
+
+    ~work_deque() {
+        delete[] m_buf;
+    }
+
+    /**
+     * @brief 分配环形数组
+     * @param capacity 最多同时容纳的任务数，向上取整到2的幂
+     */
+    void init(int capacity) {
+        long size = 1;
+        while (size < capacity)
+            size <<= 1;
+        m_buf = new std::atomic<T *>[size];
+        for (long i = 0; i < size; ++i)
+            m_buf[i].store(NULL, std::memory_order_relaxed);
+        m_mask = size - 1;
+    }
+
+    /**
+     * @brief 所属线程在底部压入一个任务
+     * @param task
+     */
+    void push(T *task) {
+        long b = m_bottom.load(std::memory_order_relaxed);
+        m_buf[b & m_mask].store(task, std::memory_order_relaxed);
+        //先写入元素再发布新的底部，窃取者看到底部变化时一定能读到元素
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 所属线程从底部取出最后压入的任务
+     * @return 队列为空或者最后一个任务被窃取时返回NULL
+     */
+    T *pop() {
+        long b = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(b, std::memory_order_relaxed);
+        //先占住底部再读顶部，和steal中的读顶部、读底部构成全序
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long t = m_top.load(std::memory_order_relaxed);
+        if (t > b) {
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return NULL;
+        }
+        T *task = m_buf[b & m_mask].load(std::memory_order_relaxed);
+        if (t == b) {
+            //只剩一个任务，和窃取者竞争顶部
+            if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                task = NULL;
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+    /**
+     * @brief 其它线程从顶部窃取最早压入的任务
+     * @return 队列为空或者和其它线程竞争失败时返回NULL
+     */
+    T *steal() {
+        long t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long b = m_bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return NULL;
+        T *task = m_buf[t & m_mask].load(std::memory_order_relaxed);
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return NULL;
+        return task;
+    }
+
+    //任意线程调用，结果只是一个瞬间的估计，用来在休眠前检查是否还有任务
+    bool empty() const {
+        return m_top.load(std::memory_order_relaxed) >= m_bottom.load(std::memory_order_relaxed);
+    }
+
+private:    //私有成员
+    std::atomic<long> m_top;        //窃取者取走的位置
+    char m_pad[64];                 //顶部和底部放在不同的缓存行，窃取不会干扰所属线程
+    std::atomic<long> m_bottom;     //所属线程压入的位置
+    long m_mask;                    //容量减一
+    std::atomic<T *> *m_buf;        //环形数组
+};
+
+#endif
@@ -22,38 +22,62 @@
 #include <sys/uio.h>
 
 #include <time.h>
+#include <vector>
 #include "../log/log.h"
 
 //util_timer类声明
 class util_timer;
 
+class event_backend;
+
+class http_conn;
+
+class conn_slab;
+
 struct client_data {
     sockaddr_in address;
     int sockfd;
+    event_backend *backend;     //连接所属事件循环的I/O后端
     util_timer *timer;
+    http_conn *conn;            //定时器对应的连接对象
+    conn_slab *slab;            //连接关闭后放回所属事件循环的连接池
+    long long idle_ms;          //空闲超时，连接还在线程池中时按它推迟定时器
 };
 
 //util_timer类
 class util_timer {
 public:     //公有成员
-    util_timer() : prev(NULL), next(NULL) {}    //构造函数
+    util_timer() : prev(NULL), next(NULL), slot(-1) {}    //构造函数
 
 public:     //公有成员
-    time_t expire;
+    long long expire;   //超时时刻，单调时钟的毫秒数
 
-    void (*cb_func)(client_data *);
+    bool (*cb_func)(client_data *);    //返回true表示已经推迟了超时时刻，定时器需要重新挂回时间轮
 
     client_data *user_data;
     util_timer *prev;
     util_timer *next;
+    int slot;           //所在的时间轮槽位，-1表示不在时间轮上
 };
 
-//定时器链表类，用于管理服务器所有连接对应的定时器
-class sort_timer_lst {
+//时间轮参数，刻度为1毫秒，第0层256个槽，第1到3层各64个槽，最长可以表示2^26毫秒约18.6小时
+const int TW_ROOT_BITS = 8;
+const int TW_LEVEL_BITS = 6;
+const int TW_ROOT_SIZE = 1 << TW_ROOT_BITS;
+const int TW_LEVEL_SIZE = 1 << TW_LEVEL_BITS;
+const int TW_LEVELS = 3;
+const int TW_SLOTS = TW_ROOT_SIZE + TW_LEVELS * TW_LEVEL_SIZE;
+const int TW_POOL_CHUNK = 1024;     //定时器节点池每次预分配的节点数
+
+//分层时间轮，用于管理一个事件循环上所有连接对应的定时器，添加、调整、删除都是O(1)
+//第0层每个槽对应1毫秒，高层的槽在低层转完一圈时下放到低层，定时器节点从节点池分配
+class timer_wheel {
 public:     //公有成员
-    sort_timer_lst();   //构造函数声明
+    timer_wheel();      //构造函数声明
+
+    ~timer_wheel();     //析构函数声明
 
-    ~sort_timer_lst();  //析构函数声明
+    util_timer *get_timer();
 
     void add_timer(util_timer *timer);
 
@@ -63,11 +87,28 @@ public:     //公有成员
 
     void tick();
 
+    int next_timeout();
+
 private:    //私有成员
-    void add_timer(util_timer *timer, util_timer *lst_head);
+    void link(util_timer *timer);
+
+    void unlink(util_timer *timer);
+
+    void cascade(int level, int index);
+
+    void run_slot(int slot);
 
-    util_timer *head;   //链表的头指针
-    util_timer *tail;   //链表的尾指针
+    long long next_expire();
+
+    void put_timer(util_timer *timer);
+
+    util_timer m_slots[TW_SLOTS];   //每个槽一个哨兵节点，槽内是双向循环链表
+    unsigned long long m_bitmap[(TW_SLOTS + 63) / 64];  //非空槽位图，用来快速找到下一个要处理的槽
+    long long m_jiffies;            //已经处理到的毫秒刻度
+    int m_count;                    //时间轮上的定时器数量
+
+    util_timer *m_free;                 //节点池空闲链表
+    std::vector<util_timer *> m_chunks; //节点池预分配的内存块
 };
 
 //Utils类
@@ -77,32 +118,22 @@ public:     //公有成员
 
     ~Utils() {} //析构函数声明
 
-    void init(int timeslot);
-
     //对文件描述符设置非阻塞
     int setnonblocking(int fd);
 
-    //将内核事件表注册读事件，ET模式，选择开启EPOLLONESHOT
-    void addfd(int epollfd, int fd, bool one_shot, int TRIGMode);
-
     //信号处理函数
     static void sig_handler(int sig);
 
     //设置信号函数
     void addsig(int sig, void(handler)(int), bool restart = true);
 
-    //定时处理任务，重新定时以不断触发SIGALRM信号
-    void timer_handler();
-
-    void show_error(int connfd, const char *info);
-
 public:
     static int *u_pipefd;       //管道文件描述符指针
-    sort_timer_lst m_timer_lst; //定时器链表
-    static int u_epollfd;       //表示 Utils 类中的所有对象共享同一个 epoll 文件描述符
-    int m_TIMESLOT;             //表示定时器的最小时间间隔
+    timer_wheel m_timer_wheel;  //定时器时间轮
 };
 
-void cb_func(client_data *user_data);   //回调函数
+bool cb_func(client_data *user_data);   //回调函数
+
+long long now_ms();     //单调时钟的当前毫秒数
 
 #endif
@@ -0,0 +1,292 @@
+#include "lst_timer.h"
+
+/**
+ * @brief 构造函数，初始化每个槽的哨兵节点并预分配节点池
+ */
+timer_wheel::timer_wheel() {
+    for (int i = 0; i < TW_SLOTS; ++i) {
+        m_slots[i].prev = &m_slots[i];
+        m_slots[i].next = &m_slots[i];
+    }
+    memset(m_bitmap, 0, sizeof(m_bitmap));
+    m_jiffies = now_ms();
+    m_count = 0;
+    m_free = NULL;
+    //预分配第一块节点
+    put_timer(get_timer());
+}
+
+/**
+ * @brief 析构函数，节点池的内存块统一释放
+ */
+timer_wheel::~timer_wheel() {
+    for (size_t i = 0; i < m_chunks.size(); ++i)
+        delete[] m_chunks[i];
+}
+
+/**
+ * @brief 从节点池取出一个定时器节点，池空时再预分配一块
+ * @return
+ */
+util_timer *timer_wheel::get_timer() {
+    if (!m_free) {
+        util_timer *chunk = new util_timer[TW_POOL_CHUNK];
+        m_chunks.push_back(chunk);
+        for (int i = 0; i < TW_POOL_CHUNK; ++i) {
+            chunk[i].next = m_free;
+            m_free = &chunk[i];
+        }
+    }
+    util_timer *timer = m_free;
+    m_free = timer->next;
+    timer->prev = NULL;
+    timer->next = NULL;
+    timer->slot = -1;
+    return timer;
+}
+
+/**
+ * @brief 把定时器节点还给节点池
+ * @param timer
+ */
+void timer_wheel::put_timer(util_timer *timer) {
+    if (!timer) {
+        return;
+    }
+    timer->slot = -1;
+    timer->next = m_free;
+    m_free = timer;
+}
+
+/**
+ * @brief 根据超时时间把定时器挂到对应层的槽上，已经超时的放到当前刻度的槽，下一次tick立即处理
+ * @param timer
+ */
+void timer_wheel::link(util_timer *timer) {
+    long long expire = timer->expire < m_jiffies ? m_jiffies : timer->expire;
+    long long delta = expire - m_jiffies;
+    int slot;
+    if (delta < TW_ROOT_SIZE) {
+        slot = (int) (expire & (TW_ROOT_SIZE - 1));
+    } else {
+        //超出最高层范围的按最高层最后一个槽处理，下放时会重新计算
+        if (delta >= (1LL << (TW_ROOT_BITS + TW_LEVELS * TW_LEVEL_BITS)))
+            expire = m_jiffies + (1LL << (TW_ROOT_BITS + TW_LEVELS * TW_LEVEL_BITS)) - 1;
+        int level = 1;
+        while (level < TW_LEVELS && delta >= (1LL << (TW_ROOT_BITS + level * TW_LEVEL_BITS)))
+            ++level;
+        int shift = TW_ROOT_BITS + (level - 1) * TW_LEVEL_BITS;
+        slot = TW_ROOT_SIZE + (level - 1) * TW_LEVEL_SIZE + (int) ((expire >> shift) & (TW_LEVEL_SIZE - 1));
+    }
+
+    util_timer *head = &m_slots[slot];
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+    timer->slot = slot;
+    m_bitmap[slot >> 6] |= 1ULL << (slot & 63);
+}
+
+/**
+ * @brief 把定时器从所在的槽上摘下
+ * @param timer
+ */
+void timer_wheel::unlink(util_timer *timer) {
+    int slot = timer->slot;
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = NULL;
+    timer->next = NULL;
+    timer->slot = -1;
+    if (m_slots[slot].next == &m_slots[slot])
+        m_bitmap[slot >> 6] &= ~(1ULL << (slot & 63));
+}
+
+/**
+ * @brief 添加定时器
+ * @param timer 指向要添加的定时器的指针，expire、cb_func、user_data需要已经设置好
+ */
+void timer_wheel::add_timer(util_timer *timer) {
+    if (!timer) {
+        return;
+    }
+    link(timer);
+    ++m_count;
+}
+
+/**
+ * @brief 定时器的超时时间被修改后调整它所在的槽
+ * @param timer
+ */
+void timer_wheel::adjust_timer(util_timer *timer) {
+    if (!timer || timer->slot < 0) {
+        return;
+    }
+    unlink(timer);
+    link(timer);
+}
+
+/**
+ * @brief 删除定时器并把节点还给节点池
+ * @param timer
+ */
+void timer_wheel::del_timer(util_timer *timer) {
+    if (!timer) {
+        return;
+    }
+    if (timer->slot >= 0) {
+        unlink(timer);
+        --m_count;
+    }
+    put_timer(timer);
+}
+
+/**
+ * @brief 把高层某个槽上的定时器按剩余时间重新挂到低层
+ * @param level
+ * @param index
+ */
+void timer_wheel::cascade(int level, int index) {
+    int slot = TW_ROOT_SIZE + (level - 1) * TW_LEVEL_SIZE + index;
+    util_timer *head = &m_slots[slot];
+    if (head->next == head) {
+        return;
+    }
+    //先把整条链表摘下来，重新挂的时候可能挂回同一层
+    util_timer *tmp = head->next;
+    head->prev->next = NULL;
+    head->prev = head;
+    head->next = head;
+    m_bitmap[slot >> 6] &= ~(1ULL << (slot & 63));
+    while (tmp) {
+        util_timer *next = tmp->next;
+        link(tmp);
+        tmp = next;
+    }
+}
+
+/**
+ * @brief 执行第0层一个槽上的所有定时器，回调执行完后节点还给节点池，
+ * 回调推迟了超时时刻的定时器重新挂回时间轮
+ * @param slot
+ */
+void timer_wheel::run_slot(int slot) {
+    util_timer *head = &m_slots[slot];
+    if (head->next == head) {
+        return;
+    }
+    util_timer *tmp = head->next;
+    head->prev->next = NULL;
+    head->prev = head;
+    head->next = head;
+    m_bitmap[slot >> 6] &= ~(1ULL << (slot & 63));
+    while (tmp) {
+        util_timer *next = tmp->next;
+        tmp->slot = -1;
+        --m_count;
+        if (tmp->cb_func(tmp->user_data))
+            add_timer(tmp);
+        else
+            put_timer(tmp);
+        tmp = next;
+    }
+}
+
+/**
+ * @brief 从当前刻度开始，到下一个需要处理的刻度还有多少毫秒，
+ * 第0层取下一个非空槽，高层取下一个非空槽下放的时刻
+ * @return 时间轮为空时返回-1
+ */
+long long timer_wheel::next_expire() {
+    if (0 == m_count) {
+        return -1;
+    }
+    long long best = -1;
+
+    //第0层，从当前槽开始环形查找第一个非空槽
+    int pos = (int) (m_jiffies & (TW_ROOT_SIZE - 1));
+    for (int k = 0; k <= TW_ROOT_SIZE / 64; ++k) {
+        int word = ((pos >> 6) + k) & (TW_ROOT_SIZE / 64 - 1);
+        unsigned long long bits = m_bitmap[word];
+        if (0 == k)
+            bits &= ~0ULL << (pos & 63);
+        else if (TW_ROOT_SIZE / 64 == k)
+            bits &= (pos & 63) ? ((1ULL << (pos & 63)) - 1) : 0;
+        if (bits) {
+            int slot = word * 64 + __builtin_ctzll(bits);
+            best = (slot - pos) & (TW_ROOT_SIZE - 1);
+            break;
+        }
+    }
+
+    //高层，当前槽在进入本轮时已经下放过，所以从下一个槽开始找，找不到就是转一整圈后的当前槽
+    for (int level = 1; level <= TW_LEVELS; ++level) {
+        //高层每层64个槽，正好对应位图的一个字
+        unsigned long long bits = m_bitmap[(TW_ROOT_SIZE + (level - 1) * TW_LEVEL_SIZE) >> 6];
+        if (!bits)
+            continue;
+        int shift = TW_ROOT_BITS + (level - 1) * TW_LEVEL_BITS;
+        int cur = (int) ((m_jiffies >> shift) & (TW_LEVEL_SIZE - 1));
+        int rot = (cur + 1) & (TW_LEVEL_SIZE - 1);
+        unsigned long long rotated = rot ? ((bits >> rot) | (bits << (TW_LEVEL_SIZE - rot))) : bits;
+        long long blocks = __builtin_ctzll(rotated) + 1;
+        long long delta = (((m_jiffies >> shift) + blocks) << shift) - m_jiffies;
+        if (best < 0 || delta < best)
+            best = delta;
+    }
+    return best;
+}
+
+/**
+ * @brief 处理定时任务，事件循环每次等待返回后调用，
+ * 从上次处理到的刻度推进到当前时间，中间没有定时器的刻度直接跳过
+ */
+void timer_wheel::tick() {
+    long long cur = now_ms();
+    while (true) {
+        long long delta = next_expire();
+        if (delta < 0 || m_jiffies + delta > cur) {
+            if (cur > m_jiffies)
+                m_jiffies = cur;
+            break;
+        }
+        m_jiffies += delta;
+
+        //第0层转完一圈时把高层的槽下放，高层也转完一圈时继续下放更高一层
+        int index = (int) (m_jiffies & (TW_ROOT_SIZE - 1));
+        if (delta > 0 && 0 == index) {
+            for (int level = 1; level <= TW_LEVELS; ++level) {
+                int shift = TW_ROOT_BITS + (level - 1) * TW_LEVEL_BITS;
+                int level_index = (int) ((m_jiffies >> shift) & (TW_LEVEL_SIZE - 1));
+                cascade(level, level_index);
+                if (level_index != 0)
+                    break;
+            }
+        }
+        run_slot(index);
+    }
+}
+
+/**
+ * @brief 距离下一个需要处理的刻度还有多少毫秒，作为事件循环的等待超时
+ * @return 没有定时器时返回-1，表示一直等待
+ */
+int timer_wheel::next_timeout() {
+    long long delta = next_expire();
+    if (delta < 0) {
+        return -1;
+    }
+    long long left = m_jiffies + delta - now_ms();
+    return left > 0 ? (int) left : 0;
+}
+
+/**
+ * @brief 单调时钟的当前毫秒数，不受系统时间调整的影响
+ * @return
+ */
+long long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
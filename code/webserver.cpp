@@ -5,8 +5,6 @@
  */
 WebServer::WebServer() {
 
-    users = new http_conn[MAX_FD];  //http_conn类对象
-
     char server_path[200];      //root文件夹路径
     chdir("../");               //改变当前工作路径
     getcwd(server_path, 200);   //获取当前工作路径,将值存放在server_path中,200为空间大小
@@ -16,20 +14,33 @@ WebServer::WebServer() {
     strcpy(m_root, server_path);//将server_path复制到m_root
     strcat(m_root, root);       //将root复制到m_root
 
-    users_timer = new client_data[MAX_FD];  //定时器
+    m_sub_loops = NULL;
+    m_reactor_num = 0;
+    m_reuseport = 0;
+    m_io_backend = 0;
+    m_sendfile_threshold = -1;
+    m_file_cache_mb = 0;
+    m_keepalive_timeout = 3 * TIMESLOT;
+    m_keepalive_requests = 0;
+    m_listenfds = NULL;
+    m_listenfd = -1;
 }
 
 /**
  * @brief 析构函数
  */
 WebServer::~WebServer() {
-    close(m_epollfd);   //关闭 epoll 文件描述符
-    close(m_listenfd);  //停止监听套接字
+    delete m_pool;          //先停止线程池，工作线程可能还在访问各事件循环的连接
+    delete[] m_sub_loops;   //释放子Reactor，其线程已在 eventLoop() 返回前退出
+    if (m_listenfd != -1)
+        close(m_listenfd);  //停止监听套接字
+    if (m_listenfds) {
+        for (int i = 0; i < m_reactor_num; ++i)
+            close(m_listenfds[i]);
+        delete[] m_listenfds;
+    }
     close(m_pipefd[1]); //关闭管道文件描述符
     close(m_pipefd[0]); //关闭管道文件描述符
-    delete[] users;     //释放 http_conn 类对象数组
-    delete[] users_timer;//释放定时器
-    delete m_pool;      //释放线程池
 }
 
 /**
@@ -45,21 +56,52 @@ WebServer::~WebServer() {
  * @param thread_num 线程数量
  * @param close_log 关闭日志
  * @param actor_model actor模型
+ * @param reactor_num 子Reactor数量，0表示单Reactor
+ * @param reuseport SO_REUSEPORT分片监听模式
+ * @param io_backend I/O后端，0为epoll，1为io_uring
+ * @param sendfile_threshold 不小于该大小的文件用sendfile发送，-1表示不使用
+ * @param file_cache_mb 静态文件缓存容量，单位MB，0表示不缓存
+ * @param keepalive_timeout 长连接空闲超时，单位秒
+ * @param keepalive_requests 每个长连接最多处理的请求数，0表示不限制
+ * @param queue_mode 请求队列的调度方式，0为工作窃取，1为共享环形队列
+ * @param thread_max 线程池最多的线程数，0表示等于thread_num
+ * @param queue_wait_ms 排队时间目标，超过时增加线程，单位毫秒
+ * @param thread_idle 多出的线程空闲超过这么多秒后退出
+ * @param static_reserved 给静态请求保留的线程数
+ * @param db_reserved 给数据库请求保留的线程数
+ * @param admin_reserved 给管理接口保留的线程数
  */
 void WebServer::init(int port, string user, string passWord, string databaseName, int log_write,
                      int opt_linger, int trigmode, int sql_num, int thread_num, int close_log,
-                     int actor_model) {
+                     int actor_model, int reactor_num, int reuseport, int io_backend,
+                     int sendfile_threshold, int file_cache_mb, int keepalive_timeout, int keepalive_requests,
+                     int queue_mode, int thread_max, int queue_wait_ms, int thread_idle,
+                     int static_reserved, int db_reserved, int admin_reserved) {
     m_port = port;                  //初始化端口号
     m_user = user;                  //初始化用户
     m_passWord = passWord;          //初始化密码
     m_databaseName = databaseName;  //初始化数据库名称
     m_sql_num = sql_num;            //初始化数据库数量
     m_thread_num = thread_num;      //初始化线程数量
+    m_queue_mode = queue_mode;      //初始化请求队列的调度方式
+    m_thread_max = thread_max;      //初始化最多线程数
+    m_queue_wait_ms = queue_wait_ms;    //初始化排队时间目标
+    m_thread_idle = thread_idle;    //初始化空闲线程退出的超时
+    m_reserved[SCHED_STATIC] = static_reserved; //初始化各调度类别保留的线程数
+    m_reserved[SCHED_DB] = db_reserved;
+    m_reserved[SCHED_ADMIN] = admin_reserved;
     m_log_write = log_write;        //初始化日志写入方式
     m_OPT_LINGER = opt_linger;      //初始化选项延迟
     m_TRIGMode = trigmode;          //初始化触发模式
     m_close_log = close_log;        //初始化关闭日志
     m_actormodel = actor_model;     //初始化事件模型
+    m_reactor_num = reactor_num;    //初始化子Reactor数量
+    m_reuseport = reuseport;        //初始化SO_REUSEPORT模式
+    m_io_backend = io_backend;      //初始化I/O后端
+    m_sendfile_threshold = sendfile_threshold;  //初始化sendfile阈值
+    m_file_cache_mb = file_cache_mb;            //初始化静态文件缓存容量
+    m_keepalive_timeout = keepalive_timeout > 0 ? keepalive_timeout : 3 * TIMESLOT;    //初始化长连接空闲超时
+    m_keepalive_requests = keepalive_requests > 0 ? keepalive_requests : 0;           //初始化长连接请求数上限
 }
 
 /**
@@ -91,6 +133,23 @@ void WebServer::trig_mode() {   //触发模式
     }
 }
 
+/**
+ * @brief 注册路由并编译成路由表，必须在事件循环和工作线程开始处理请求之前调用
+ * 新的动态接口在这里用add_callback注册，不需要修改http_conn
+ */
+void WebServer::route() {
+    router *r = router::get_instance();
+    r->add_file("/", "/judge.html");            //判断界面
+    r->add_file("/0", "/register.html");        //注册界面
+    r->add_file("/1", "/log.html");             //登录界面
+    r->add_login("/2CGISQL.cgi");               //登录校验
+    r->add_register("/3CGISQL.cgi");            //注册校验
+    r->add_file("/5", "/picture.html");
+    r->add_file("/6", "/video.html");
+    r->add_file("/7", "/fans.html");
+    r->compile();
+}
+
 /**
  * @brief 打开日志文件，用来记录 Web 服务器的运行日志
  */
@@ -113,7 +172,8 @@ void WebServer::sql_pool() {    //数据库
     m_connPool->init("localhost", m_user, m_passWord, m_databaseName, 3306, m_sql_num, m_close_log);
 
     //初始化数据库读取表
-    users->initmysql_result(m_connPool);
+    http_conn conn;
+    conn.initmysql_result(m_connPool);
 }
 
 /**
@@ -121,27 +181,32 @@ void WebServer::sql_pool() {    //数据库
  */
 void WebServer::thread_pool() {
     //线程池
-    m_pool = new threadpool<http_conn>(m_actormodel, m_connPool, m_thread_num);
+    m_pool = new threadpool<http_conn>(m_actormodel, m_thread_num, 10000,
+                                       1 == m_queue_mode ? QUEUE_RING : QUEUE_WORK_STEALING,
+                                       m_thread_max, m_queue_wait_ms, m_thread_idle, m_reserved, m_close_log);
 }
 
 /**
- * @brief 创建并监听套接字，等待客户端连接请求
+ * @brief 创建一个监听套接字
+ * @param reuseport 是否设置SO_REUSEPORT，多个套接字绑定同一端口由内核分发连接
+ * @param cpu 大于等于0时设置SO_INCOMING_CPU，优先把该CPU收到的连接交给这个套接字
+ * @return 监听套接字
  */
-void WebServer::eventListen() {     //监听
+int WebServer::open_listenfd(bool reuseport, int cpu) {
     //网络编程基础步骤
 
     //1.创建套接字
-    m_listenfd = socket(PF_INET, SOCK_STREAM, 0);   //ipv4和字节流，SOCK_STREAM      DRAGM
+    int listenfd = socket(PF_INET, SOCK_STREAM, 0);   //ipv4和字节流，SOCK_STREAM      DRAGM
 
-    assert(m_listenfd >= 0);
+    assert(listenfd >= 0);
 
     //2.优雅关闭连接
     if (0 == m_OPT_LINGER) {
         struct linger tmp = {0, 1};
-        setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+        setsockopt(listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
     } else if (1 == m_OPT_LINGER) {
         struct linger tmp = {1, 1};
-        setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+        setsockopt(listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
     }
 
     int ret = 0;
@@ -152,299 +217,92 @@ void WebServer::eventListen() {     //监听
     address.sin_port = htons(m_port);
 
     int flag = 1;
-    setsockopt(m_listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));  //可重用TIME_WAIT状态的TCP连接
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));  //可重用TIME_WAIT状态的TCP连接
+    if (reuseport) {
+        ret = setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag));
+        assert(ret >= 0);
+    }
+    if (cpu >= 0) {
+        //内核不支持时忽略，连接仍按四元组哈希分发
+        setsockopt(listenfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
+    }
 
     //3.绑定地址，将套接字绑定到地址和端口上
-    ret = bind(m_listenfd, (struct sockaddr *) &address, sizeof(address));  //命名socket，命名到服务器本机的所有网卡的9006端口
+    ret = bind(listenfd, (struct sockaddr *) &address, sizeof(address));  //命名socket，命名到服务器本机的所有网卡的9006端口
     assert(ret >= 0);
 
     //4.监听套接字
-    ret = listen(m_listenfd, 5);    //创建监听队列，监听，accecpt
+    //创建监听队列，监听，accecpt；分片时每个套接字各有一个队列，都按系统上限，突发的连接不会因为队列满被丢弃后等SYN重传
+    ret = listen(listenfd, SOMAXCONN);
     assert(ret >= 0);
 
-    //5.初始化定时器
-    utils.init(TIMESLOT);
+    return listenfd;
+}
 
-    //6.epoll创建内核事件表 epoll poll select epoll_create 内核事件表 epoll_wait epoll_ctl
-    epoll_event events[MAX_EVENT_NUMBER];
-    m_epollfd = epoll_create(5);    //size 5已经失效
-    assert(m_epollfd != -1);
+/**
+ * @brief 创建并监听套接字，等待客户端连接请求
+ */
+void WebServer::eventListen() {     //监听
+    int ret = 0;
+
+    //1-4.主从Reactor开启SO_REUSEPORT时由各子Reactor自己监听，否则共用一个监听套接字
+    bool sharded = m_reuseport && m_reactor_num > 0;
+    if (!sharded)
+        m_listenfd = open_listenfd(m_reuseport != 0, -1);
 
-    //7.添加监听套接字到事件表，这里将第三个参数设置为 false，表示使用 LT 模式，将第四个参数设置为 m_LISTENTrigmode，表示触发模式
-    utils.addfd(m_epollfd, m_listenfd, false, m_LISTENTrigmode);
-    //8.将 HTTP 连接的 epoll 事件表设置为 m_epollfd
-    http_conn::m_epollfd = m_epollfd;
+    //静态文件缓存，所有事件循环和工作线程共享
+    file_cache::get_instance()->init((long long) m_file_cache_mb * 1024 * 1024, m_sendfile_threshold, m_close_log);
 
-    //9.建立双向管道来发送信号，将可读可写事件与信号事件统一事件源
+    //5.建立双向管道来发送信号，将可读可写事件与信号事件统一事件源，定时器由各事件循环的等待超时驱动
     ret = socketpair(PF_UNIX, SOCK_STREAM, 0, m_pipefd);    //1写0读，将两端都非阻塞LT，然后epollfd监听0读端
     assert(ret != -1);
     utils.setnonblocking(m_pipefd[1]);
-    utils.addfd(m_epollfd, m_pipefd[0], false, 0);
 
     utils.addsig(SIGPIPE, SIG_IGN);
-    utils.addsig(SIGALRM, utils.sig_handler, false);
     utils.addsig(SIGTERM, utils.sig_handler, false);
 
-    alarm(TIMESLOT);
-
     //工具类,信号和描述符基础操作
     Utils::u_pipefd = m_pipefd;
-    Utils::u_epollfd = m_epollfd;
-}
-
-/**
- * @brief 进入事件循环，处理客户端连接请求和定时器事件
- */
-void WebServer::eventLoop() {
-    bool timeout = false;
-    bool stop_server = false;
-
-    while (!stop_server) {
-        //使用 epoll_wait() 函数来等待事件的发生
-        int number = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER, -1);
-        if (number < 0 && errno != EINTR) {
-            LOG_ERROR("%s", "epoll failure");
-            break;
-        }
-
-        //遍历所有就绪事件，处理事件
-        for (int i = 0; i < number; i++) {
-            int sockfd = events[i].data.fd;
-
-            //1.表示有新的客户端连接请求，调用 dealclinetdata() 函数来处理连接请求
-            if (sockfd == m_listenfd) {
-                bool flag = dealclinetdata();
-                if (false == flag)
-                    continue;
-            }
-            //2.表示客户端连接已经断开，移除对应的定时器，并清理相应的资源
-            else if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
-                //服务器端关闭连接，移除对应的定时器
-                util_timer *timer = users_timer[sockfd].timer;
-                deal_timer(timer, sockfd);
-            }
-            //3.表示收到了一个信号，调用 dealwithsignal() 函数来处理信号
-            else if ((sockfd == m_pipefd[0]) && (events[i].events & EPOLLIN)) {
-                bool flag = dealwithsignal(timeout, stop_server);
-                if (false == flag)
-                    LOG_ERROR("%s", "dealclientdata failure");
-            }
-            //4.表示客户端有数据到来，调用 dealwithread() 函数来处理客户端请求
-            else if (events[i].events & EPOLLIN) {
-                dealwithread(sockfd);
-            }
-            //5.表示服务器端可以向客户端发送数据，调用 dealwithwrite() 函数来发送数据
-            else if (events[i].events & EPOLLOUT) {
-                dealwithwrite(sockfd);
-            }
-        }
-        if (timeout) {
-            //当 timeout 标志位为 true 时，说明定时器事件已经触发，调用 timer_handler() 函数来处理定时器事件
-            utils.timer_handler();
-
-            LOG_INFO("%s", "timer tick");
-            //将 timeout 标志位设置为 false，表示定时器事件已经处理完毕
-            timeout = false;
-        }
-    }
-}
-
-/**
- * @brief 添加定时器，用来处理客户端连接超时事件
- * @param connfd
- * @param client_address
- */
-void WebServer::timer(int connfd, struct sockaddr_in client_address) {
-    users[connfd].init(connfd, client_address, m_root, m_CONNTrigmode, m_close_log, m_user, m_passWord, m_databaseName);
-
-    //初始化client_data数据
-    //创建定时器，设置回调函数和超时时间，绑定用户数据，将定时器添加到链表中
-    users_timer[connfd].address = client_address;
-    users_timer[connfd].sockfd = connfd;
-    util_timer *timer = new util_timer;
-    timer->user_data = &users_timer[connfd];
-    timer->cb_func = cb_func;
-    time_t cur = time(NULL);
-    timer->expire = cur + 3 * TIMESLOT;
-    users_timer[connfd].timer = timer;
-    utils.m_timer_lst.add_timer(timer);
-}
-
-/**
- * @brief 调整定时器，用来更新定时器的超时时间
- * @param timer
- */
-void WebServer::adjust_timer(util_timer *timer) {
-    time_t cur = time(NULL);
-    timer->expire = cur + 3 * TIMESLOT;
-    utils.m_timer_lst.adjust_timer(timer);
 
-    LOG_INFO("%s", "adjust timer once");
-}
-
-/**
- * @brief 处理定时器事件，用来关闭超时的客户端连接
- * @param timer
- * @param sockfd
- */
-void WebServer::deal_timer(util_timer *timer, int sockfd) {
-    timer->cb_func(&users_timer[sockfd]);
-    if (timer) {
-        utils.m_timer_lst.del_timer(timer);
-    }
-
-    LOG_INFO("close fd %d", users_timer[sockfd].sockfd);
-}
-
-/**
- * @brief 处理客户端数据，包括解析 HTTP 请求和生成 HTTP 响应
- * @return
- */
-bool WebServer::dealclinetdata() {
-    struct sockaddr_in client_address;
-    socklen_t client_addrlength = sizeof(client_address);
-    if (0 == m_LISTENTrigmode) {    //LT模式
-        //获取到的新客户连接fd
-        int connfd = accept(m_listenfd, (struct sockaddr *) &client_address, &client_addrlength);
-        if (connfd < 0) {
-            LOG_ERROR("%s:errno is:%d", "accept error", errno);
-            return false;
-        }
-        if (http_conn::m_user_count >= MAX_FD) {
-            utils.show_error(connfd, "Internal server busy");
-            LOG_ERROR("%s", "Internal server busy");
-            return false;
-        }
-        //将connfd添加到epollfd中
-        timer(connfd, client_address);
-    } else {    //监听socket是ET模式
-        while (1) {
-            int connfd = accept(m_listenfd, (struct sockaddr *) &client_address, &client_addrlength);
-            if (connfd < 0) {
-                LOG_ERROR("%s:errno is:%d", "accept error", errno);
-                break;
-            }
-            if (http_conn::m_user_count >= MAX_FD) {
-                utils.show_error(connfd, "Internal server busy");
-                LOG_ERROR("%s", "Internal server busy");
-                break;
-            }
-            timer(connfd, client_address);
-        }
-        return false;
-    }
-    return true;
-}
-
-/**
- * @brief 处理信号事件，包括定时器信号和终止信号
- * @param timeout
- * @param stop_server
- * @return
- */
-bool WebServer::dealwithsignal(bool &timeout, bool &stop_server) {
-    int ret = 0;
-    int sig;
-    char signals[1024];
-    ret = recv(m_pipefd[0], signals, sizeof(signals), 0);
-    if (ret == -1) {
-        return false;
-    } else if (ret == 0) {
-        return false;
-    } else {
-        for (int i = 0; i < ret; ++i) {
-            switch (signals[i]) {
-                case SIGALRM: {
-                    timeout = true;
-                    break;
-                }
-                case SIGTERM: {
-                    stop_server = true;
-                    break;
-                }
-            }
-        }
-    }
-    return true;
-}
-
-/**
- * @brief 处理读事件，用来读取客户端发送的数据
- * @param sockfd
- */
-void WebServer::dealwithread(int sockfd) {
-    util_timer *timer = users_timer[sockfd].timer;
-
-    //reactor
-    if (1 == m_actormodel) {
-        if (timer) {
-            adjust_timer(timer);
-        }
-
-        //若监测到读事件，将该事件放入请求队列    user --> http_conn users[10000];
-        m_pool->append(users + sockfd, 0);  // sockfd 从内核空间读到用户空间，用户肯定要有内存 sockfd http_conn user[sockfd]
-
-        while (true) {
-            if (1 == users[sockfd].improv) {
-                if (1 == users[sockfd].timer_flag) {
-                    deal_timer(timer, sockfd);
-                    users[sockfd].timer_flag = 0;
-                }
-                users[sockfd].improv = 0;
-                break;
+    //6.主Reactor创建epoll内核事件表，监听listenfd和信号管道的可读事件
+    m_main_loop.init(m_pool, m_root, m_CONNTrigmode, m_actormodel, m_close_log, m_io_backend,
+                     m_keepalive_timeout, m_keepalive_requests);
+    if (!sharded)
+        m_main_loop.add_listen(m_listenfd, m_LISTENTrigmode);
+    m_main_loop.add_signal(m_pipefd[0]);
+
+    //7.主从Reactor模式下，每个子Reactor各有一个epoll和一个线程，主Reactor只负责accept后轮询派发
+    //  SO_REUSEPORT模式下每个子Reactor自己accept，主Reactor只处理信号
+    if (m_reactor_num > 0) {
+        long cpu_num = sysconf(_SC_NPROCESSORS_ONLN);
+        m_sub_loops = new event_loop[m_reactor_num];
+        if (sharded)
+            m_listenfds = new int[m_reactor_num];
+        for (int i = 0; i < m_reactor_num; ++i) {
+            //模式2把第i个子Reactor固定在第i个CPU上，连接由收到它的CPU上的子Reactor处理
+            int cpu = (2 == m_reuseport && cpu_num > 0) ? (int) (i % cpu_num) : -1;
+            m_sub_loops[i].init(m_pool, m_root, m_CONNTrigmode, m_actormodel, m_close_log, m_io_backend,
+                                m_keepalive_timeout, m_keepalive_requests);
+            if (sharded) {
+                m_listenfds[i] = open_listenfd(true, cpu);
+                m_sub_loops[i].add_listen(m_listenfds[i], m_LISTENTrigmode);
             }
+            m_sub_loops[i].start(cpu);
         }
-    } else {
-        //proactor
-        if (users[sockfd].read_once()) {
-            LOG_INFO("deal with the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
-
-            //若监测到读事件，将该事件放入请求队列
-            m_pool->append_p(users + sockfd);
-
-            if (timer) {
-                adjust_timer(timer);
-            }
-        } else {
-            deal_timer(timer, sockfd);
-        }
+        if (!sharded)
+            m_main_loop.set_sub_loops(m_sub_loops, m_reactor_num);
     }
 }
 
 /**
- * @brief 处理写事件，用来向客户端发送数据
- * @param sockfd
+ * @brief 进入事件循环，处理客户端连接请求和定时器事件
  */
-void WebServer::dealwithwrite(int sockfd) {
-    util_timer *timer = users_timer[sockfd].timer;
-    //reactor
-    if (1 == m_actormodel) {
-        if (timer) {
-            adjust_timer(timer);
-        }
-
-        m_pool->append(users + sockfd, 1);
-
-        while (true) {
-            if (1 == users[sockfd].improv) {
-                if (1 == users[sockfd].timer_flag) {
-                    deal_timer(timer, sockfd);
-                    users[sockfd].timer_flag = 0;
-                }
-                users[sockfd].improv = 0;
-                break;
-            }
-        }
-    } else {
-        //proactor
-        if (users[sockfd].write()) {
-            LOG_INFO("send data to the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
+void WebServer::eventLoop() {
+    //主Reactor运行在主线程，收到SIGTERM后返回
+    m_main_loop.loop();
 
-            if (timer) {
-                adjust_timer(timer);
-            }
-        } else {
-            deal_timer(timer, sockfd);
-        }
-    }
+    for (int i = 0; i < m_reactor_num; ++i)
+        m_sub_loops[i].stop();
+    for (int i = 0; i < m_reactor_num; ++i)
+        m_sub_loops[i].join();
 }
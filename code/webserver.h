@@ -14,10 +14,8 @@
 
 #include "./threadpool/threadpool.h"
 #include "./http/http_conn.h"
-
-const int MAX_FD = 65536;           //最大文件描述符
-const int MAX_EVENT_NUMBER = 10000; //最大事件数
-const int TIMESLOT = 5;             //最小超时单位
+#include "./http/router.h"
+#include "./reactor/event_loop.h"
 
 //WebServer类
 class WebServer {
@@ -28,7 +26,10 @@ public:     //公有成员
 
     void init(int port, string user, string passWord, string databaseName,
               int log_write, int opt_linger, int trigmode, int sql_num,
-              int thread_num, int close_log, int actor_model);
+              int thread_num, int close_log, int actor_model, int reactor_num, int reuseport, int io_backend,
+              int sendfile_threshold, int file_cache_mb, int keepalive_timeout, int keepalive_requests,
+              int queue_mode, int thread_max, int queue_wait_ms, int thread_idle,
+              int static_reserved, int db_reserved, int admin_reserved);
 
     void thread_pool();
 
@@ -38,23 +39,14 @@ public:     //公有成员
 
     void trig_mode();
 
+    void route();
+
     void eventListen();
 
     void eventLoop();
 
-    void timer(int connfd, struct sockaddr_in client_address);
-
-    void adjust_timer(util_timer *timer);
-
-    void deal_timer(util_timer *timer, int sockfd);
-
-    bool dealclinetdata();
-
-    bool dealwithsignal(bool &timeout, bool &stop_server);
-
-    void dealwithread(int sockfd);
-
-    void dealwithwrite(int sockfd);
+private:    //私有成员
+    int open_listenfd(bool reuseport, int cpu);
 
 public:     //公有成员
     //基础
@@ -64,9 +56,7 @@ public:     //公有成员
     int m_close_log;    //是否关闭日志记录功能
     int m_actormodel;   //I/O 多路复用模式，包括 Reactor 和 Proactor 两种模式
 
-    int m_pipefd[2];    //用来处理定时器信号的管道
-    int m_epollfd;      //Epoll 的文件描述符
-    http_conn *users;   //HTTP 连接数组，用来保存所有客户端连接
+    int m_pipefd[2];    //用来处理终止信号的管道
 
     //数据库相关
     connection_pool *m_connPool;//数据库连接池
@@ -78,9 +68,23 @@ public:     //公有成员
     //线程池相关
     threadpool<http_conn> *m_pool;  //线程池
     int m_thread_num;               //线程池的线程数
-
-    //epoll_event相关
-    epoll_event events[MAX_EVENT_NUMBER];   //Epoll 事件数组，用来保存所有的事件
+    int m_queue_mode;               //请求队列的调度方式，0为工作窃取，1为共享环形队列
+    int m_thread_max;               //线程池最多的线程数，不大于m_thread_num时线程数固定
+    int m_queue_wait_ms;            //排队时间目标，超过时增加线程，单位毫秒
+    int m_thread_idle;              //多出的线程空闲超过这么多秒后退出
+    int m_reserved[SCHED_CLASS_NUM];    //给静态、数据库、管理接口各调度类别保留的线程数
+
+    //事件循环相关
+    event_loop m_main_loop;     //主Reactor，负责 accept 和信号；单Reactor时也负责所有连接
+    event_loop *m_sub_loops;    //子Reactor数组，每个子Reactor一个线程、一个epoll
+    int m_reactor_num;          //子Reactor数量，0表示单Reactor
+    int m_reuseport;            //0共用一个监听套接字，1每个子Reactor一个SO_REUSEPORT监听套接字，2再绑定CPU
+    int *m_listenfds;           //SO_REUSEPORT模式下每个子Reactor自己的监听套接字
+    int m_io_backend;           //I/O后端，0为epoll，1为io_uring
+    int m_sendfile_threshold;   //不小于该大小的文件用sendfile发送，-1表示不使用
+    int m_file_cache_mb;        //静态文件缓存容量，单位MB，0表示不缓存
+    int m_keepalive_timeout;    //长连接空闲超时，单位秒
+    int m_keepalive_requests;   //每个长连接最多处理的请求数，0表示不限制
 
     int m_listenfd;         //监听套接字
     int m_OPT_LINGER;       //是否启用优雅关闭
@@ -89,7 +93,6 @@ public:     //公有成员
     int m_CONNTrigmode;     //连接套接字的 I/O 多路复用模式
 
     //定时器相关
-    client_data *users_timer;   //存储所有连接对应的定时器信息
     Utils utils;                //包含了一些常用的时间处理函数
 };
 